@@ -0,0 +1,335 @@
+/**
+ * Host-side benchmark harness for the platform-independent core.
+ *
+ * Built by the `native` environment only (the esp32-c3 environment
+ * filters this file out). Exercises the pieces that carry the hot
+ * path - the binary frame encoder, the SPSC sample ring, the filter
+ * kernels, and the live-stats accumulator - so performance work can be
+ * validated in CI-time seconds instead of flash-and-pray cycles on
+ * hardware. Host throughput is not ESP32-C3 throughput, but relative
+ * movement between two commits is meaningful, and the correctness
+ * asserts run on every invocation.
+ *
+ * Usage:
+ *   pio run -e native && .pio/build/native/program [trace.csv]
+ *
+ * With a trace file ("timestamp_us,raw" per line, as recorded from a
+ * real HX711) the full filter -> decimate -> encode pipeline replays
+ * it and reports per-sample cost; without one a synthetic thrust curve
+ * stands in.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "wire_format.h"
+#include "ring_buffer.h"
+#include "filter.h"
+#include "live_stats.h"
+#include "perf.h"
+#include "pipeline.h"
+
+// Mirrors the firmware defaults (config.h is not part of this build)
+static const uint32_t SAMPLE_RATE_HZ = 80;
+static const size_t BATCH_SAMPLES = 10;
+
+struct BenchSample {
+  uint32_t timestamp_us;
+  int32_t raw;
+};
+
+static double secondsSince(
+    std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// ---------------------------------------------------------------
+// Trace input: recorded HX711 CSV, or a synthetic thrust curve
+// ---------------------------------------------------------------
+
+static std::vector<BenchSample> loadTrace(const char* path) {
+  std::vector<BenchSample> trace;
+  FILE* f = fopen(path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "cannot open trace %s\n", path);
+    exit(1);
+  }
+  char line[128];
+  while (fgets(line, sizeof(line), f)) {
+    unsigned long ts;
+    long raw;
+    if (sscanf(line, "%lu,%ld", &ts, &raw) == 2) {
+      trace.push_back({(uint32_t)ts, (int32_t)raw});
+    }
+  }
+  fclose(f);
+  printf("trace: %s, %zu samples\n", path, trace.size());
+  return trace;
+}
+
+static std::vector<BenchSample> syntheticTrace(size_t samples) {
+  // Ramp up, plateau with noise, tail off - close enough in spectral
+  // shape to a motor burn to exercise the filters realistically
+  std::vector<BenchSample> trace;
+  trace.reserve(samples);
+  uint32_t dt_us = 1000000 / SAMPLE_RATE_HZ;
+  for (size_t i = 0; i < samples; i++) {
+    double t = (double)i / samples;
+    double envelope =
+        (t < 0.1) ? t / 0.1 : (t > 0.7) ? (1.0 - t) / 0.3 : 1.0;
+    int32_t noise = (int32_t)(rand() % 2001) - 1000;
+    trace.push_back(
+        {(uint32_t)(i * dt_us), (int32_t)(envelope * 500000) + noise});
+  }
+  return trace;
+}
+
+// ---------------------------------------------------------------
+// Encoder throughput
+// ---------------------------------------------------------------
+
+static void benchEncoder(const std::vector<BenchSample>& trace) {
+  uint8_t buf[wire::batchFrameSize(BATCH_SAMPLES)];
+  wire::BatchEncoder enc(buf, BATCH_SAMPLES);
+
+  const int REPEAT = 200;
+  size_t frames = 0;
+  size_t bytes = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < REPEAT; r++) {
+    uint32_t seq = 0;
+    enc.begin(seq);
+    for (const BenchSample& s : trace) {
+      enc.add(s.timestamp_us, s.raw, (float)s.raw * 0.001f);
+      if (enc.full()) {
+        bytes += enc.finish();
+        frames++;
+        enc.begin(++seq);
+      }
+    }
+    bytes += enc.finish();
+    frames++;
+  }
+  double secs = secondsSince(start);
+
+  size_t samples = trace.size() * REPEAT;
+  printf("encode:   %zu samples in %.3fs -> %.1f Msamples/s, %.1f MB/s "
+         "(%zu frames)\n",
+         samples, secs, samples / secs / 1e6, bytes / secs / 1e6, frames);
+
+  // Sanity: a frame we encode must decode (CRC included)
+  enc.begin(7);
+  enc.add(123456, -42, -0.42f);
+  size_t len = enc.finish();
+  if (len < 2 ||
+      wire::crc16(buf, len - 2) !=
+          (uint16_t)(buf[len - 2] | (buf[len - 1] << 8))) {
+    fprintf(stderr, "encode: round-trip CRC check FAILED\n");
+    exit(1);
+  }
+}
+
+// ---------------------------------------------------------------
+// Ring buffer: throughput and producer/consumer contention
+// ---------------------------------------------------------------
+
+static void benchRing() {
+  // Same geometry as the firmware's send ring at the default config
+  static SpscRing<BenchSample, SAMPLE_RATE_HZ * 4> ring;
+
+  const size_t TOTAL = 1000000;
+  size_t consumed = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  std::thread producer([&] {
+    for (size_t i = 0; i < TOTAL; i++) {
+      BenchSample s = {(uint32_t)i, (int32_t)i};
+      while (!ring.push(s)) {
+        // The firmware drops instead, but for a contention benchmark
+        // every sample must arrive; yield rather than hot-spin so the
+        // consumer can actually drain the tiny ring
+        std::this_thread::yield();
+      }
+    }
+  });
+  BenchSample out;
+  uint32_t expect = 0;
+  while (consumed < TOTAL) {
+    if (ring.pop(out)) {
+      if (out.timestamp_us != expect++) {
+        fprintf(stderr, "ring: ordering violated at %u\n", out.timestamp_us);
+        exit(1);
+      }
+      consumed++;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+  double secs = secondsSince(start);
+
+  printf("ring:     %zu handoffs in %.3fs -> %.1f Mops/s, high-water "
+         "%zu/%zu\n",
+         TOTAL, secs, TOTAL / secs / 1e6, ring.highWater(), ring.capacity());
+}
+
+// ---------------------------------------------------------------
+// Pipeline replay: filter -> decimate -> encode, per-sample cost
+// ---------------------------------------------------------------
+
+static void benchPipeline(const std::vector<BenchSample>& trace) {
+  FilterStage filter;
+  filter.setLowpass(10.0f, (float)SAMPLE_RATE_HZ);
+
+  LiveStats stats(5.0f);
+
+  uint8_t buf[wire::batchFrameSize(BATCH_SAMPLES)];
+  wire::BatchEncoder enc(buf, BATCH_SAMPLES);
+
+  const int REPEAT = 200;
+  CycleStats perSample;  // nanoseconds here, not cycles
+
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < REPEAT; r++) {
+    filter.setLowpass(10.0f, (float)SAMPLE_RATE_HZ);
+    stats.reset();
+    uint32_t seq = 0;
+    uint8_t decimPhase = 0;
+    enc.begin(seq);
+    for (const BenchSample& s : trace) {
+      auto t0 = std::chrono::steady_clock::now();
+      int32_t filtered = filter.apply(s.raw);
+      float force = (float)filtered * 0.001f;
+      stats.update(s.timestamp_us, force);
+      if (++decimPhase >= 4) {  // 80 -> 20 Hz, the dashboard rate
+        decimPhase = 0;
+        enc.add(s.timestamp_us, filtered, force);
+        if (enc.full()) {
+          enc.finish();
+          enc.begin(++seq);
+        }
+      }
+      perSample.add((uint32_t)std::chrono::duration_cast<
+                        std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - t0)
+                        .count());
+    }
+  }
+  double secs = secondsSince(start);
+
+  size_t samples = trace.size() * REPEAT;
+  printf("pipeline: %zu samples in %.3fs -> %.1f Msamples/s "
+         "(per-sample min/mean/max %u/%u/%u ns)\n",
+         samples, secs, samples / secs / 1e6, perSample.minCycles(),
+         perSample.meanCycles(), perSample.maxCycles());
+  printf("          impulse %.2f Ns, peak %.1f N over %u samples\n",
+         stats.impulseNs(), stats.peakForce(), stats.sampleCount());
+}
+
+// ---------------------------------------------------------------
+// Specialized pipelines: runtime dispatch vs compile-time templates
+// ---------------------------------------------------------------
+
+// Swallows finished frames; the byte count keeps the optimizer honest
+struct CountSink {
+  size_t bytes = 0;
+  size_t frames = 0;
+  void onFrame(const uint8_t*, size_t len) {
+    bytes += len;
+    frames++;
+  }
+};
+
+static const float BENCH_SCALE[1] = {420.5f};
+static const long BENCH_OFFSET[1] = {-1234};
+
+template <typename Pipe>
+static double runPipeline(const std::vector<BenchSample>& trace, int repeat,
+                          Pipe& pipe) {
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < repeat; r++) {
+    for (const BenchSample& s : trace) {
+      pipe.push(s.timestamp_us, &s.raw);
+    }
+    pipe.flush();
+  }
+  return secondsSince(start);
+}
+
+static void benchSpecialized(const std::vector<BenchSample>& trace) {
+  const int REPEAT = 200;
+  size_t samples = trace.size() * REPEAT;
+
+  // Baseline and specialization share the Pipeline skeleton and
+  // differ only in the filter policy, so the delta is the dispatch
+  // itself (FilterStage's per-sample mode switch), not incidental
+  // compiler luck on two differently shaped loops
+  double runtimeSecs;
+  {
+    uint8_t buf[wire::batchFrameSize(BATCH_SAMPLES)];
+    pipeline::BatchPolicy<1> enc(buf, BATCH_SAMPLES);
+    CountSink sink;
+    pipeline::Pipeline<FilterStage, pipeline::BatchPolicy<1>, CountSink, 1,
+                       4>
+        pipe(enc, sink, BENCH_SCALE, BENCH_OFFSET);
+    pipe.filter(0).setLowpass(10.0f, (float)SAMPLE_RATE_HZ);
+    runtimeSecs = runPipeline(trace, REPEAT, pipe);
+    printf("spec:     dispatched  lowpass/4/batch  %6.1f Msamples/s "
+           "(%zu frames)\n",
+           samples / runtimeSecs / 1e6, sink.frames);
+  }
+
+  // Same configuration with the kernel bound at compile time
+  {
+    uint8_t buf[wire::batchFrameSize(BATCH_SAMPLES)];
+    pipeline::BatchPolicy<1> enc(buf, BATCH_SAMPLES);
+    CountSink sink;
+    pipeline::Pipeline<FixedBiquad, pipeline::BatchPolicy<1>, CountSink, 1,
+                       4>
+        pipe(enc, sink, BENCH_SCALE, BENCH_OFFSET);
+    pipe.filter(0).configureLowpass(10.0f, (float)SAMPLE_RATE_HZ);
+    double secs = runPipeline(trace, REPEAT, pipe);
+    printf("spec:     specialized lowpass/4/batch  %6.1f Msamples/s "
+           "(%+.0f%% vs dispatched)\n",
+           samples / secs / 1e6, (runtimeSecs / secs - 1.0) * 100.0);
+  }
+
+  // The minimal fixed-function build: single channel, no filter, no
+  // decimation, delta frames
+  {
+    uint8_t buf[wire::deltaBatchFrameSize(BATCH_SAMPLES, 1)];
+    pipeline::DeltaPolicy<1> enc(buf, BATCH_SAMPLES);
+    CountSink sink;
+    pipeline::Pipeline<pipeline::PassFilter, pipeline::DeltaPolicy<1>,
+                       CountSink, 1, 1>
+        pipe(enc, sink, BENCH_SCALE, BENCH_OFFSET);
+    double secs = runPipeline(trace, REPEAT, pipe);
+    printf("spec:     specialized raw/1/delta      %6.1f Msamples/s "
+           "(%.2f bytes/sample)\n",
+           samples / secs / 1e6, (double)sink.bytes / (double)samples);
+  }
+}
+
+int main(int argc, char** argv) {
+  std::vector<BenchSample> trace = (argc > 1)
+                                       ? loadTrace(argv[1])
+                                       : syntheticTrace(SAMPLE_RATE_HZ * 60);
+
+  benchEncoder(trace);
+  benchRing();
+  benchPipeline(trace);
+  benchSpecialized(trace);
+
+  printf("ok\n");
+  return 0;
+}
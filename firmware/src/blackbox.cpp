@@ -0,0 +1,156 @@
+/**
+ * On-device black-box recorder - implementation.
+ */
+
+#include "blackbox.h"
+#include "log.h"
+
+bool Blackbox::begin() {
+  if (!LittleFS.begin(true)) {  // format on first mount failure
+    LOG_ERROR("LittleFS mount failed");
+    return false;
+  }
+  mounted_ = true;
+
+  LOG_INFO("LittleFS mounted: %u KB used of %u KB",
+           (unsigned)(LittleFS.usedBytes() / 1024),
+           (unsigned)(LittleFS.totalBytes() / 1024));
+  return true;
+}
+
+bool Blackbox::startLog(uint32_t start_us, uint8_t channels,
+                        const float* scale, const long* offset) {
+  if (!mounted_ || logging_ || channels == 0) {
+    return false;
+  }
+
+  // Next free slot
+  for (int i = 0; i < 1000; i++) {
+    snprintf(path_, sizeof(path_), "/test_%03d.rtl", i);
+    if (!LittleFS.exists(path_)) {
+      break;
+    }
+  }
+
+  file_ = LittleFS.open(path_, FILE_WRITE);
+  if (!file_) {
+    LOG_ERROR("Cannot open black-box log %s", path_);
+    return false;
+  }
+
+  channels_ = channels;
+
+  // Worst case: a keyframe record, or a delta record where every
+  // varint takes its full width
+  size_t keyframe = 2 + 4 + (size_t)channels_ * 4;
+  size_t delta = wire::VARINT_MAX * (1 + (size_t)channels_);
+  maxRecord_ = (keyframe > delta) ? keyframe : delta;
+
+  // Header goes through the chunk buffer like everything else
+  bufUsed_ = 0;
+  buf_[bufUsed_++] = 'R';
+  buf_[bufUsed_++] = 'T';
+  buf_[bufUsed_++] = 'L';
+  buf_[bufUsed_++] = '3';
+  buf_[bufUsed_++] = channels_;
+  buf_[bufUsed_++] = 0;
+  buf_[bufUsed_++] = 0;
+  buf_[bufUsed_++] = 0;
+  bufUsed_ += wire::putU32(buf_ + bufUsed_, start_us);
+  bufUsed_ += wire::putU32(buf_ + bufUsed_, 0);  // count, patched at close
+  for (uint8_t ch = 0; ch < channels_; ch++) {
+    bufUsed_ += wire::putFloat(buf_ + bufUsed_, scale[ch]);
+    bufUsed_ += wire::putI32(buf_ + bufUsed_, (int32_t)offset[ch]);
+  }
+
+  samples_ = 0;
+  logging_ = true;
+
+  // The header goes to flash right away: a reset in the first seconds
+  // of a test (the ignition-EMI window) must still leave an unclean
+  // log behind for crash recovery to find - a zero-length file looks
+  // like no test at all.
+  flushChunk();
+  file_.flush();
+
+  LOG_INFO("Black-box logging to %s", path_);
+  return true;
+}
+
+void Blackbox::log(uint32_t timestamp_us, const int32_t* raw) {
+  if (!logging_) {
+    return;
+  }
+
+  if (samples_ % KEYFRAME_INTERVAL == 0) {
+    // Absolute keyframe; the marker lets the reader detect a torn
+    // record at the next cadence point instead of decoding garbage
+    buf_[bufUsed_++] = KEYFRAME_MARK0;
+    buf_[bufUsed_++] = KEYFRAME_MARK1;
+    bufUsed_ += wire::putU32(buf_ + bufUsed_, timestamp_us);
+    for (uint8_t ch = 0; ch < channels_; ch++) {
+      bufUsed_ += wire::putI32(buf_ + bufUsed_, raw[ch]);
+    }
+  } else {
+    bufUsed_ += wire::putVarint(
+        buf_ + bufUsed_,
+        wire::zigzag32((int32_t)(timestamp_us - lastTimestamp_)));
+    for (uint8_t ch = 0; ch < channels_; ch++) {
+      bufUsed_ += wire::putVarint(buf_ + bufUsed_,
+                                  wire::zigzag32(raw[ch] - lastRaw_[ch]));
+    }
+  }
+
+  lastTimestamp_ = timestamp_us;
+  for (uint8_t ch = 0; ch < channels_; ch++) {
+    lastRaw_[ch] = raw[ch];
+  }
+  samples_++;
+
+  if (bufUsed_ + maxRecord_ > WRITE_CHUNK) {
+    flushChunk();
+  }
+}
+
+void Blackbox::sync() {
+  if (!logging_) {
+    return;
+  }
+  flushChunk();
+  file_.flush();
+}
+
+void Blackbox::stopLog() {
+  if (!logging_) {
+    return;
+  }
+
+  flushChunk();
+
+  // Patch the now-known record count into the header; a log whose
+  // count is still zero was cut short by a reset mid-test
+  if (file_.seek(HEADER_SIZE)) {
+    uint8_t count[4];
+    wire::putU32(count, samples_);
+    file_.write(count, sizeof(count));
+  }
+
+  file_.close();
+  logging_ = false;
+
+  LOG_INFO("Black-box log %s closed: %lu samples", path_,
+           (unsigned long)samples_);
+}
+
+void Blackbox::flushChunk() {
+  if (bufUsed_ == 0) {
+    return;
+  }
+
+  size_t written = file_.write(buf_, bufUsed_);
+  if (written != bufUsed_) {
+    LOG_ERROR("Black-box short write (%u of %u bytes)", (unsigned)written,
+              (unsigned)bufUsed_);
+  }
+  bufUsed_ = 0;
+}
@@ -0,0 +1,104 @@
+/**
+ * On-device black-box recorder.
+ *
+ * During TESTING every sample is appended to a LittleFS log file so a
+ * WiFi dropout mid-burn no longer loses data: live streaming is
+ * best-effort, the flash log is the record of truth. Samples are
+ * buffered in RAM and written in full 4 KB sector-aligned chunks so
+ * flash I/O happens rarely and never from the acquisition side (the
+ * loop task does the writing, the sampler task is unaffected).
+ *
+ * File layout ("RTL3", delta-compressed):
+ *   bytes 0..3    magic "RTL3"
+ *   byte  4       channel count
+ *   bytes 5..7    reserved (zero)
+ *   bytes 8..11   start timestamp, us since boot (uint32 LE)
+ *   bytes 12..15  record count (uint32 LE, patched in at stopLog();
+ *                 0 means the log was never closed cleanly)
+ *   then per channel: calibration scale (float32), offset (int32)
+ *   then records. Every KEYFRAME_INTERVAL-th record (starting with the
+ *   first) is an absolute keyframe - marker 0xA5 0x5A, timestamp
+ *   (uint32), raw (int32) per channel - and the records between are
+ *   zigzag varints of the timestamp and per-channel raw deltas.
+ *
+ * Force is not stored: the calibration in the header reconstructs it
+ * from the raw counts at upload time. Together with delta coding this
+ * is a 3-5x size reduction on real burns, which is that many more
+ * full-rate tests per flash. The keyframe cadence is positional (the
+ * reader counts records); the marker bytes exist so a truncated or
+ * torn record is detected at the next keyframe instead of silently
+ * corrupting the rest of the decode.
+ *
+ * "RTL1" (single-channel, 8-byte header) was retired when multi-channel
+ * support landed; "RTL2" (fixed 12-byte raw+force records) when delta
+ * compression did. Old RTL2 files still on flash upload fine - the
+ * reader in main.cpp keeps both paths.
+ */
+
+#ifndef BLACKBOX_H
+#define BLACKBOX_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+#include "wire_format.h"
+
+class Blackbox {
+ public:
+  static const size_t HEADER_SIZE = 12;    // fixed part, shared with RTL2
+  static const size_t WRITE_CHUNK = 4096;  // one flash sector per write
+  static const uint32_t KEYFRAME_INTERVAL = 64;
+  static const uint8_t KEYFRAME_MARK0 = 0xA5;
+  static const uint8_t KEYFRAME_MARK1 = 0x5A;
+
+  /** Bytes per fixed RTL2 sample record (legacy upload path). */
+  static size_t recordSize(uint8_t channels) {
+    return 4 + (size_t)channels * 8;
+  }
+
+  /** Full RTL3 header: fixed part + count + per-channel calibration. */
+  static size_t headerSize(uint8_t channels) {
+    return HEADER_SIZE + 4 + (size_t)channels * 8;
+  }
+
+  /** Mount LittleFS (formatting on first use). Call once from setup(). */
+  bool begin();
+
+  /** Open the next free log file and write its header, capturing the
+   *  calibration so force can be rebuilt from raw counts at upload. */
+  bool startLog(uint32_t start_us, uint8_t channels, const float* scale,
+                const long* offset);
+
+  /** Append one sample (raw holds one entry per channel). Cheap (RAM
+   *  copy plus varint math) except when a full chunk goes to flash. */
+  void log(uint32_t timestamp_us, const int32_t* raw);
+
+  /** Push buffered records to flash now (off the per-sample path;
+   *  used after the pre-trigger dump so an early reset cannot erase
+   *  everything recorded so far). */
+  void sync();
+
+  /** Flush the partial chunk and close the file. */
+  void stopLog();
+
+  bool isLogging() const { return logging_; }
+  const char* currentFile() const { return path_; }
+  uint32_t samplesLogged() const { return samples_; }
+
+ private:
+  void flushChunk();
+
+  File file_;
+  char path_[32] = {0};
+  uint8_t buf_[WRITE_CHUNK];
+  size_t bufUsed_ = 0;
+  size_t maxRecord_ = 0;  // worst-case record, for the chunk-full check
+  uint8_t channels_ = 1;
+  uint32_t samples_ = 0;
+  uint32_t lastTimestamp_ = 0;
+  int32_t lastRaw_[8] = {0};
+  bool logging_ = false;
+  bool mounted_ = false;
+};
+
+#endif  // BLACKBOX_H
@@ -0,0 +1,149 @@
+/**
+ * Embedded viewer page for field (AP) mode.
+ *
+ * At the range there is no Flask server and no internet, so the page
+ * the phone loads from http://192.168.4.1/ has to be self-contained:
+ * no Socket.IO, no Chart.js, just a canvas trace and a WebSocket
+ * client that decodes the binary stream (reading and batch frames,
+ * CRC-checked) directly in JavaScript. Commands go back over the same
+ * connection as the usual {"type": ...} JSON, so Start/Stop/Tare work
+ * like the dashboard's.
+ *
+ * Served verbatim from flash by the two-line HTTP responder in
+ * stepLink(); kept small on purpose. The WebSocket port constant in
+ * the script must stay in step with AP_WS_PORT.
+ */
+
+#ifndef FIELD_PAGE_H
+#define FIELD_PAGE_H
+
+#include <pgmspace.h>
+
+static const char FIELD_PAGE[] PROGMEM = R"HTML(<!DOCTYPE html>
+<html lang="en">
+<head>
+<meta charset="UTF-8">
+<meta name="viewport" content="width=device-width, initial-scale=1.0">
+<title>Test Stand - Field Mode</title>
+<style>
+body { font-family: sans-serif; background: #1a1a2e; color: #eee; margin: 0; padding: 12px; }
+h1 { font-size: 1.2em; margin: 0 0 8px; }
+#status { color: #e94560; } #status.up { color: #4ecca3; }
+canvas { width: 100%; height: 260px; background: #16213e; border-radius: 6px; }
+.stats { display: flex; gap: 16px; margin: 8px 0; }
+.stats div { flex: 1; background: #16213e; border-radius: 6px; padding: 8px; text-align: center; }
+.stats b { display: block; font-size: 1.4em; }
+button { font-size: 1em; padding: 10px 18px; margin-right: 8px; border: 0; border-radius: 6px; color: #fff; background: #0f3460; }
+#start { background: #4ecca3; color: #1a1a2e; } #stop { background: #e94560; }
+</style>
+</head>
+<body>
+<h1>&#128640; Test Stand <span id="status">connecting...</span></h1>
+<canvas id="trace" width="800" height="260"></canvas>
+<div class="stats">
+<div>Current<b id="cur">0.00</b>N</div>
+<div>Peak<b id="peak">0.00</b>N</div>
+<div>Impulse<b id="imp">0.00</b>N&middot;s</div>
+</div>
+<button id="start">Start Test</button>
+<button id="stop">Stop Test</button>
+<button id="tare">Tare</button>
+<script>
+"use strict";
+var WS_PORT = 81;  // AP_WS_PORT
+var trace = [], peak = 0, ws = null;
+var canvas = document.getElementById("trace"), ctx = canvas.getContext("2d");
+var WINDOW_US = 10 * 1000000;  // 10 s of history on screen
+
+function crc16(view, len) {
+  var crc = 0xFFFF;
+  for (var i = 0; i < len; i++) {
+    crc ^= view.getUint8(i) << 8;
+    for (var b = 0; b < 8; b++)
+      crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) & 0xFFFF : (crc << 1) & 0xFFFF;
+  }
+  return crc;
+}
+
+function addSample(ts, force) {
+  trace.push([ts, force]);
+  if (force > peak) peak = force;
+  while (trace.length > 1 && ts - trace[0][0] > WINDOW_US) trace.shift();
+  document.getElementById("cur").textContent = force.toFixed(2);
+  document.getElementById("peak").textContent = peak.toFixed(2);
+}
+
+// Binary wire v2 (see wire_format.h): reading 0x01, batch 0x02,
+// multi-channel batch 0x03. Channel 0 (axial) is what gets plotted.
+function onFrame(buf) {
+  var v = new DataView(buf);
+  if (buf.byteLength < 6 || v.getUint8(0) != 0x52 || v.getUint8(1) != 0x54 ||
+      v.getUint8(2) != 2) return;
+  if (crc16(v, buf.byteLength - 2) != v.getUint16(buf.byteLength - 2, true)) return;
+  var type = v.getUint8(3);
+  if (type == 0x01) {
+    addSample(v.getUint32(8, true), v.getFloat32(16, true));
+  } else if (type == 0x02 || type == 0x03) {
+    var count = v.getUint16(8, true);
+    var channels = (type == 0x03) ? v.getUint8(10) : 1;
+    var off = (type == 0x03) ? 11 : 10;
+    for (var i = 0; i < count; i++) {
+      addSample(v.getUint32(off, true), v.getFloat32(off + 8, true));
+      off += 4 + channels * 8;
+    }
+  }
+}
+
+function onText(text) {
+  var msg;
+  try { msg = JSON.parse(text); } catch (e) { return; }
+  if (msg.type == "live_stats")
+    document.getElementById("imp").textContent = msg.impulse_ns.toFixed(2);
+}
+
+function draw() {
+  ctx.clearRect(0, 0, canvas.width, canvas.height);
+  if (trace.length > 1) {
+    var t0 = trace[0][0], span = Math.max(trace[trace.length - 1][0] - t0, 1);
+    var top = Math.max(peak, 1);
+    ctx.strokeStyle = "#4ecca3"; ctx.lineWidth = 2; ctx.beginPath();
+    for (var i = 0; i < trace.length; i++) {
+      var x = (trace[i][0] - t0) / span * canvas.width;
+      var y = canvas.height - 10 - trace[i][1] / top * (canvas.height - 20);
+      i ? ctx.lineTo(x, y) : ctx.moveTo(x, y);
+    }
+    ctx.stroke();
+  }
+  requestAnimationFrame(draw);
+}
+
+function connect() {
+  ws = new WebSocket("ws://" + location.hostname + ":" + WS_PORT);
+  ws.binaryType = "arraybuffer";
+  ws.onopen = function () {
+    var s = document.getElementById("status");
+    s.textContent = "connected"; s.className = "up";
+  };
+  ws.onclose = function () {
+    var s = document.getElementById("status");
+    s.textContent = "reconnecting..."; s.className = "";
+    setTimeout(connect, 1000);
+  };
+  ws.onmessage = function (ev) {
+    if (ev.data instanceof ArrayBuffer) onFrame(ev.data); else onText(ev.data);
+  };
+}
+
+function send(type) { if (ws && ws.readyState == 1) ws.send(JSON.stringify({ type: type })); }
+document.getElementById("start").onclick = function () { peak = 0; trace = []; send("start_test"); };
+document.getElementById("stop").onclick = function () { send("stop_test"); };
+document.getElementById("tare").onclick = function () { send("tare"); };
+
+connect();
+draw();
+</script>
+</body>
+</html>
+)HTML";
+
+#endif  // FIELD_PAGE_H
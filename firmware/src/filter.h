@@ -0,0 +1,178 @@
+/**
+ * Fixed-point digital filtering for the live sample stream.
+ *
+ * Runs on the raw 24-bit HX711 counts between the send ring and the
+ * network, selected per test with the set_filter command. Filtering at
+ * the source lets the live stream be decimated without aliasing -
+ * cutting bandwidth to what the dashboard actually plots - while the
+ * full-rate unfiltered data still lands in the black-box log, which
+ * remains the record of truth.
+ *
+ * Two kernels:
+ *  - median-of-N (N up to 5): kills the single-sample spikes the
+ *    HX711 emits near supply transients, zero phase distortion on
+ *    monotone ramps;
+ *  - low-pass biquad (RBJ cookbook, Butterworth Q): coefficients are
+ *    computed in floating point once at configure time, then quantized
+ *    to Q28 so the per-sample path is pure integer multiply-accumulate
+ *    in an int64 - no float math per sample on a core without an FPU.
+ *
+ * Like wire_format.h, free of Arduino dependencies so the kernels can
+ * be compiled and exercised on the host.
+ */
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdint.h>
+#include <math.h>
+
+/** Median of the last N raw values (N odd, at most 5). */
+class MedianFilter {
+ public:
+  static const uint8_t MAX_N = 5;
+
+  void configure(uint8_t n) {
+    n_ = (n > MAX_N) ? MAX_N : ((n < 3) ? 3 : n);
+    if ((n_ & 1) == 0) {
+      n_--;  // keep N odd so the median is a real sample
+    }
+    reset();
+  }
+
+  void reset() {
+    count_ = 0;
+    head_ = 0;
+  }
+
+  int32_t apply(int32_t raw) {
+    window_[head_] = raw;
+    head_ = (head_ + 1) % n_;
+    if (count_ < n_) {
+      count_++;
+    }
+    if (count_ < n_) {
+      return raw;  // warm-up: pass through until the window fills
+    }
+
+    // Insertion sort of a copy; at N <= 5 this is a handful of ops
+    int32_t sorted[MAX_N];
+    for (uint8_t i = 0; i < n_; i++) {
+      sorted[i] = window_[i];
+    }
+    for (uint8_t i = 1; i < n_; i++) {
+      int32_t v = sorted[i];
+      int8_t j = i - 1;
+      while (j >= 0 && sorted[j] > v) {
+        sorted[j + 1] = sorted[j];
+        j--;
+      }
+      sorted[j + 1] = v;
+    }
+    return sorted[n_ / 2];
+  }
+
+ private:
+  int32_t window_[MAX_N] = {0};
+  uint8_t n_ = 3;
+  uint8_t head_ = 0;
+  uint8_t count_ = 0;
+};
+
+/** Direct-form-1 biquad with Q28 integer coefficients. */
+class FixedBiquad {
+ public:
+  static const int SHIFT = 28;
+
+  /** Butterworth low-pass at cutoff_hz for a sample_rate_hz stream. */
+  void configureLowpass(float cutoff_hz, float sample_rate_hz) {
+    // RBJ audio EQ cookbook, Q = 1/sqrt(2)
+    float w0 = 2.0f * (float)M_PI * cutoff_hz / sample_rate_hz;
+    float cw = cosf(w0);
+    float alpha = sinf(w0) / (2.0f * 0.70710678f);
+    float a0 = 1.0f + alpha;
+
+    b0_ = quantize((1.0f - cw) * 0.5f / a0);
+    b1_ = quantize((1.0f - cw) / a0);
+    b2_ = b0_;
+    a1_ = quantize(-2.0f * cw / a0);
+    a2_ = quantize((1.0f - alpha) / a0);
+    reset();
+  }
+
+  void reset() {
+    x1_ = x2_ = y1_ = y2_ = 0;
+    primed_ = false;
+  }
+
+  int32_t apply(int32_t raw) {
+    if (!primed_) {
+      // Start the filter at the signal's level, not at zero, so the
+      // first samples are not a giant step response
+      x1_ = x2_ = y1_ = y2_ = raw;
+      primed_ = true;
+    }
+
+    int64_t acc = (int64_t)b0_ * raw + (int64_t)b1_ * x1_ +
+                  (int64_t)b2_ * x2_ - (int64_t)a1_ * y1_ -
+                  (int64_t)a2_ * y2_;
+    int32_t y = (int32_t)((acc + (1LL << (SHIFT - 1))) >> SHIFT);
+
+    x2_ = x1_;
+    x1_ = raw;
+    y2_ = y1_;
+    y1_ = y;
+    return y;
+  }
+
+ private:
+  static int32_t quantize(float c) {
+    return (int32_t)lrintf(c * (float)(1L << SHIFT));
+  }
+
+  int32_t b0_ = 1 << SHIFT, b1_ = 0, b2_ = 0, a1_ = 0, a2_ = 0;
+  int32_t x1_ = 0, x2_ = 0, y1_ = 0, y2_ = 0;
+  bool primed_ = false;
+};
+
+/** Per-channel filter selector for the send path. */
+class FilterStage {
+ public:
+  enum Mode {
+    MODE_NONE,
+    MODE_MEDIAN,
+    MODE_LOWPASS
+  };
+
+  void setNone() { mode_ = MODE_NONE; }
+
+  void setMedian(uint8_t n) {
+    median_.configure(n);
+    mode_ = MODE_MEDIAN;
+  }
+
+  void setLowpass(float cutoff_hz, float sample_rate_hz) {
+    biquad_.configureLowpass(cutoff_hz, sample_rate_hz);
+    mode_ = MODE_LOWPASS;
+  }
+
+  int32_t apply(int32_t raw) {
+    switch (mode_) {
+      case MODE_MEDIAN:
+        return median_.apply(raw);
+      case MODE_LOWPASS:
+        return biquad_.apply(raw);
+      default:
+        return raw;
+    }
+  }
+
+  Mode mode() const { return mode_; }
+
+ private:
+  Mode mode_ = MODE_NONE;
+  MedianFilter median_;
+  FixedBiquad biquad_;
+};
+
+#endif  // FILTER_H
@@ -0,0 +1,109 @@
+#include "hx711_multi.h"
+
+#include "log.h"
+
+static portMUX_TYPE hx711Mux = portMUX_INITIALIZER_UNLOCKED;
+
+void Hx711Multi::begin(uint8_t sckPin, const uint8_t* doutPins,
+                       uint8_t channels) {
+  sck_ = sckPin;
+  channels_ = (channels > MAX_CHANNELS) ? MAX_CHANNELS : channels;
+  for (uint8_t ch = 0; ch < channels_; ch++) {
+    dout_[ch] = doutPins[ch];
+    pinMode(dout_[ch], INPUT);
+  }
+  pinMode(sck_, OUTPUT);
+  digitalWrite(sck_, LOW);
+}
+
+void Hx711Multi::setGain(uint8_t gain) {
+  switch (gain) {
+    case 64: extraPulses_ = 3; break;
+    case 32: extraPulses_ = 2; break;
+    default: extraPulses_ = 1; break;  // 128
+  }
+}
+
+bool Hx711Multi::isReady() {
+  for (uint8_t ch = 0; ch < channels_; ch++) {
+    if (digitalRead(dout_[ch]) == HIGH) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Hx711Multi::waitReady(unsigned long timeout_ms) {
+  unsigned long start = millis();
+  while (!isReady()) {
+    if (millis() - start >= timeout_ms) {
+      return false;
+    }
+    delay(1);
+  }
+  return true;
+}
+
+void Hx711Multi::readAll(int32_t* raw) {
+  uint32_t value[MAX_CHANNELS] = {0};
+
+  // One pulse train clocks every chip: with SCK shared, each rising
+  // edge shifts the next bit onto all DOUT lines at once. Interrupts
+  // stay off for the burst - an SCK high stretched past 60 us is the
+  // power-down command.
+  portENTER_CRITICAL(&hx711Mux);
+  for (uint8_t bit = 0; bit < 24; bit++) {
+    digitalWrite(sck_, HIGH);
+    delayMicroseconds(1);
+    for (uint8_t ch = 0; ch < channels_; ch++) {
+      value[ch] = (value[ch] << 1) | (uint32_t)digitalRead(dout_[ch]);
+    }
+    digitalWrite(sck_, LOW);
+    delayMicroseconds(1);
+  }
+  // Gain-select pulses for the next conversion
+  for (uint8_t p = 0; p < extraPulses_; p++) {
+    digitalWrite(sck_, HIGH);
+    delayMicroseconds(1);
+    digitalWrite(sck_, LOW);
+    delayMicroseconds(1);
+  }
+  portEXIT_CRITICAL(&hx711Mux);
+
+  for (uint8_t ch = 0; ch < channels_; ch++) {
+    // Sign-extend the 24-bit two's-complement word
+    if (value[ch] & 0x800000) {
+      value[ch] |= 0xFF000000;
+    }
+    raw[ch] = (int32_t)value[ch];
+  }
+}
+
+void Hx711Multi::readAverage(int32_t* avg, uint8_t samples) {
+  int64_t sum[MAX_CHANNELS] = {0};
+  int32_t raw[MAX_CHANNELS];
+
+  for (uint8_t i = 0; i < samples; i++) {
+    if (!waitReady(200)) {
+      LOG_WARN("HX711 not ready during averaged read");
+      break;
+    }
+    readAll(raw);
+    for (uint8_t ch = 0; ch < channels_; ch++) {
+      sum[ch] += raw[ch];
+    }
+  }
+  for (uint8_t ch = 0; ch < channels_; ch++) {
+    avg[ch] = (int32_t)(sum[ch] / samples);
+  }
+}
+
+void Hx711Multi::powerDown() {
+  digitalWrite(sck_, LOW);
+  digitalWrite(sck_, HIGH);
+  delayMicroseconds(64);  // >60 us high powers every chip down
+}
+
+void Hx711Multi::powerUp() {
+  digitalWrite(sck_, LOW);
+}
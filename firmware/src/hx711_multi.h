@@ -0,0 +1,62 @@
+/**
+ * Multi-channel HX711 driver with a shared clock line.
+ *
+ * Stands with more than one load cell (axial thrust plus side loads)
+ * wire every HX711's PD_SCK to the same GPIO and give each its own
+ * DOUT. The chips convert concurrently, and because they share the
+ * clock, one 24-pulse burst shifts all of them out in parallel: N
+ * channels cost the same blocking time as one. Reading three cells
+ * sequentially through the single-channel library would triple the
+ * time spent with interrupts off - untenable at 80 SPS.
+ *
+ * The pulse train runs inside a critical section like the original
+ * library's: a pulse stretched past 60 us by an interrupt would power
+ * the chips down mid-read. Readiness is all DOUT lines low; the chips
+ * free-run on internal oscillators, so the slowest one gates the
+ * effective sample rate (worst case a few percent under nominal).
+ */
+
+#ifndef HX711_MULTI_H
+#define HX711_MULTI_H
+
+#include <Arduino.h>
+
+class Hx711Multi {
+ public:
+  static const uint8_t MAX_CHANNELS = 4;
+
+  /** Configure pins. doutPins must stay valid for the object's life. */
+  void begin(uint8_t sckPin, const uint8_t* doutPins, uint8_t channels);
+
+  /** Channel A gain: 128 (default), 64, or 32 (channel B). Applies
+   *  from the conversion after next. */
+  void setGain(uint8_t gain);
+
+  /** True when every channel has a conversion waiting (all DOUT low). */
+  bool isReady();
+
+  /** Block until all channels are ready or the timeout expires. */
+  bool waitReady(unsigned long timeout_ms);
+
+  /** Clock all channels out in parallel into raw[channels()],
+   *  sign-extended to 32 bits. Call only when isReady(). */
+  void readAll(int32_t* raw);
+
+  /** Blocking average of `samples` parallel reads per channel, for
+   *  tare and calibration. */
+  void readAverage(int32_t* avg, uint8_t samples);
+
+  uint8_t channels() const { return channels_; }
+  uint8_t doutPin(uint8_t channel) const { return dout_[channel]; }
+
+  void powerDown();
+  void powerUp();
+
+ private:
+  uint8_t sck_ = 0;
+  uint8_t channels_ = 0;
+  uint8_t dout_[MAX_CHANNELS] = {0};
+  uint8_t extraPulses_ = 1;  // gain select: 1=128, 3=64, 2=32
+};
+
+#endif  // HX711_MULTI_H
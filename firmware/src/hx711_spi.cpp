@@ -0,0 +1,116 @@
+#include "hx711_spi.h"
+
+#include "log.h"
+
+void Hx711Spi::begin(uint8_t sckPin, const uint8_t* doutPins,
+                     uint8_t channels) {
+  (void)channels;  // always one; enforced at compile time in main.cpp
+  sck_ = sckPin;
+  dout_ = doutPins[0];
+
+  // DOUT stays readable as a plain GPIO (data-ready polling and the
+  // falling-edge ISR) while also feeding SPI2's MISO via the matrix.
+  pinMode(dout_, INPUT);
+
+  spi_bus_config_t bus = {};
+  bus.mosi_io_num = -1;  // nothing to transmit
+  bus.miso_io_num = dout_;
+  bus.sclk_io_num = sck_;
+  bus.quadwp_io_num = -1;
+  bus.quadhd_io_num = -1;
+
+  esp_err_t err = spi_bus_initialize(SPI2_HOST, &bus, SPI_DMA_CH_AUTO);
+  if (err != ESP_OK) {
+    LOG_ERROR("SPI bus init failed: %d", (int)err);
+    return;
+  }
+
+  // Mode 1: clock idles low (SCK high >60 us is the HX711 power-down
+  // command, so the idle level matters) and data is sampled on the
+  // falling edge, after the chip shifted it out on the rising edge.
+  // 1 MHz keeps the 0.2 us minimum high time with margin.
+  spi_device_interface_config_t dev = {};
+  dev.clock_speed_hz = 1000000;
+  dev.mode = 1;
+  dev.spics_io_num = -1;  // no chip select on an HX711
+  dev.queue_size = 1;
+
+  err = spi_bus_add_device(SPI2_HOST, &dev, &dev_);
+  if (err != ESP_OK) {
+    LOG_ERROR("SPI device add failed: %d", (int)err);
+    dev_ = nullptr;
+  }
+}
+
+void Hx711Spi::setGain(uint8_t gain) {
+  switch (gain) {
+    case 64: extraPulses_ = 3; break;
+    case 32: extraPulses_ = 2; break;
+    default: extraPulses_ = 1; break;  // 128
+  }
+}
+
+bool Hx711Spi::isReady() {
+  return digitalRead(dout_) == LOW;
+}
+
+bool Hx711Spi::waitReady(unsigned long timeout_ms) {
+  unsigned long start = millis();
+  while (!isReady()) {
+    if (millis() - start >= timeout_ms) {
+      return false;
+    }
+    delay(1);
+  }
+  return true;
+}
+
+void Hx711Spi::readAll(int32_t* raw) {
+  if (dev_ == nullptr) {
+    raw[0] = 0;
+    return;
+  }
+
+  // One transaction covers the data word and the gain-select pulses;
+  // the bits clocked in during the extra pulses land past byte 2 and
+  // are ignored. Queue + collect rather than a polling transfer: the
+  // CPU is free (interrupts on) while the controller runs the burst.
+  spi_transaction_t t = {};
+  t.length = 24 + extraPulses_;
+  t.rxlength = 24 + extraPulses_;
+  t.flags = SPI_TRANS_USE_RXDATA | SPI_TRANS_USE_TXDATA;
+
+  esp_err_t err = spi_device_queue_trans(dev_, &t, portMAX_DELAY);
+  if (err == ESP_OK) {
+    spi_transaction_t* done = nullptr;
+    err = spi_device_get_trans_result(dev_, &done, portMAX_DELAY);
+  }
+  if (err != ESP_OK) {
+    LOG_ERROR("SPI HX711 read failed: %d", (int)err);
+    raw[0] = 0;
+    return;
+  }
+
+  // MSB-first: the 24 data bits fill the first three rx bytes exactly
+  uint32_t value = ((uint32_t)t.rx_data[0] << 16) |
+                   ((uint32_t)t.rx_data[1] << 8) | (uint32_t)t.rx_data[2];
+  if (value & 0x800000) {
+    value |= 0xFF000000;  // sign-extend the 24-bit two's-complement word
+  }
+  raw[0] = (int32_t)value;
+}
+
+void Hx711Spi::readAverage(int32_t* avg, uint8_t samples) {
+  int64_t sum = 0;
+  int32_t raw;
+
+  for (uint8_t i = 0; i < samples; i++) {
+    if (!waitReady(200)) {
+      LOG_WARN("HX711 not ready during averaged read");
+      break;
+    }
+    readAll(&raw);
+    sum += raw;
+  }
+  avg[0] = (int32_t)(sum / samples);
+}
@@ -0,0 +1,65 @@
+/**
+ * HX711 driver on the SPI peripheral (single channel).
+ *
+ * The bit-bang drivers hold a critical section for the whole 25-pulse
+ * burst - interrupts off for ~70 us per sample, 80 times a second,
+ * which shows up as jitter in everything else (WebSocket keepalives
+ * included). The HX711's interface is just "clock out N bits, MSB
+ * first", which is exactly what a SPI controller does in hardware: the
+ * ESP32-C3 GPIO matrix routes SPI2's SCLK onto the existing SCK pin
+ * and MISO onto DOUT, no rewiring needed.
+ *
+ * One transaction of 24 + gain-select bits (mode 1: idle-low clock,
+ * sample on the falling edge, matching the HX711 timing diagram) is
+ * queued to the controller and the completed word collected afterwards;
+ * the CPU runs freely - interrupts enabled - while the peripheral does
+ * the clocking, and the pulse count is exact so the gain selection
+ * stays correct. This removes the last synchronous bit-banged I/O from
+ * the acquisition path.
+ *
+ * Single-channel only: the controller has one MISO, so parallel
+ * multi-cell stands stay on the shared-SCK bit-bang driver
+ * (hx711_multi.h). Selected with HX711_USE_SPI in config.h.
+ */
+
+#ifndef HX711_SPI_H
+#define HX711_SPI_H
+
+#include <Arduino.h>
+#include <driver/spi_master.h>
+
+class Hx711Spi {
+ public:
+  static const uint8_t MAX_CHANNELS = 4;  // interface parity; uses one
+
+  /** Route SPI2 onto the HX711 pins. Only doutPins[0] is used. */
+  void begin(uint8_t sckPin, const uint8_t* doutPins, uint8_t channels);
+
+  /** Channel A gain: 128 (default), 64, or 32 (channel B). Applies
+   *  from the conversion after next. */
+  void setGain(uint8_t gain);
+
+  /** True when a conversion is waiting (DOUT low). */
+  bool isReady();
+
+  /** Block until ready or the timeout expires. */
+  bool waitReady(unsigned long timeout_ms);
+
+  /** Clock the 24-bit word out through the SPI controller into raw[0],
+   *  sign-extended. Call only when isReady(). */
+  void readAll(int32_t* raw);
+
+  /** Blocking average of `samples` reads, for tare and calibration. */
+  void readAverage(int32_t* avg, uint8_t samples);
+
+  uint8_t channels() const { return 1; }
+  uint8_t doutPin(uint8_t) const { return dout_; }
+
+ private:
+  spi_device_handle_t dev_ = nullptr;
+  uint8_t dout_ = 0;
+  uint8_t sck_ = 0;
+  uint8_t extraPulses_ = 1;  // gain select: 1=128, 3=64, 2=32
+};
+
+#endif  // HX711_SPI_H
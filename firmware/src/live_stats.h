@@ -0,0 +1,105 @@
+/**
+ * Streaming test statistics, updated in O(1) per sample.
+ *
+ * The server recomputes the full analysis after a test, but when a
+ * burn is going wrong the operator needs total-impulse-so-far and peak
+ * thrust on the dashboard now, not after upload and post-processing.
+ * This keeps a running trapezoidal impulse integral, peak force, and
+ * burn start/end detection (threshold crossing debounced over a few
+ * consecutive samples) during TESTING; main.cpp emits the summary once
+ * a second.
+ *
+ * Like wire_format.h, deliberately free of Arduino dependencies so it
+ * can be compiled and exercised on the host.
+ */
+
+#ifndef LIVE_STATS_H
+#define LIVE_STATS_H
+
+#include <stdint.h>
+
+class LiveStats {
+ public:
+  /** threshold_n: force above which the motor counts as burning;
+   *  debounce: consecutive samples required to enter/leave the burn. */
+  explicit LiveStats(float threshold_n, uint8_t debounce = 3)
+      : threshold_(threshold_n), debounce_(debounce) {
+    reset();
+  }
+
+  void reset() {
+    impulse_ = 0.0;
+    peakForce_ = 0.0f;
+    peakAtUs_ = 0;
+    samples_ = 0;
+    burnStartUs_ = 0;
+    burnEndUs_ = 0;
+    burnStarted_ = false;
+    burnEnded_ = false;
+    above_ = 0;
+    below_ = 0;
+    lastTimestampUs_ = 0;
+    lastForce_ = 0.0f;
+  }
+
+  void update(uint32_t timestamp_us, float force_n) {
+    if (samples_ > 0) {
+      // Unsigned subtraction stays correct across the 32-bit wrap
+      uint32_t dt_us = timestamp_us - lastTimestampUs_;
+      impulse_ += (double)(lastForce_ + force_n) * 0.5 * dt_us * 1e-6;
+    }
+    lastTimestampUs_ = timestamp_us;
+    lastForce_ = force_n;
+    samples_++;
+
+    if (force_n > peakForce_) {
+      peakForce_ = force_n;
+      peakAtUs_ = timestamp_us;
+    }
+
+    // Burn edges, debounced so a single noisy sample cannot trigger
+    if (force_n >= threshold_) {
+      below_ = 0;
+      if (!burnStarted_ && ++above_ >= debounce_) {
+        burnStarted_ = true;
+        burnStartUs_ = timestamp_us;
+      }
+    } else {
+      above_ = 0;
+      if (burnStarted_ && !burnEnded_ && ++below_ >= debounce_) {
+        burnEnded_ = true;
+        burnEndUs_ = timestamp_us;
+      }
+    }
+  }
+
+  /** Running impulse integral in newton-seconds. */
+  double impulseNs() const { return impulse_; }
+  float peakForce() const { return peakForce_; }
+  uint32_t peakAtUs() const { return peakAtUs_; }
+  uint32_t sampleCount() const { return samples_; }
+
+  bool burnStarted() const { return burnStarted_; }
+  bool burnEnded() const { return burnEnded_; }
+  uint32_t burnStartUs() const { return burnStartUs_; }
+  uint32_t burnEndUs() const { return burnEndUs_; }
+
+ private:
+  float threshold_;
+  uint8_t debounce_;
+
+  double impulse_ = 0.0;
+  float peakForce_ = 0.0f;
+  uint32_t peakAtUs_ = 0;
+  uint32_t samples_ = 0;
+  uint32_t burnStartUs_ = 0;
+  uint32_t burnEndUs_ = 0;
+  bool burnStarted_ = false;
+  bool burnEnded_ = false;
+  uint8_t above_ = 0;
+  uint8_t below_ = 0;
+  uint32_t lastTimestampUs_ = 0;
+  float lastForce_ = 0.0f;
+};
+
+#endif  // LIVE_STATS_H
@@ -0,0 +1,78 @@
+/**
+ * Compile-time leveled logging - implementation.
+ *
+ * The line queue is written from both the loop task and the sampler
+ * task, so slot reservation sits in a short critical section; the
+ * expensive part (vsnprintf, UART) happens outside it.
+ */
+
+#include "log.h"
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+namespace {
+
+const size_t LINE_LEN = 96;
+const size_t QUEUE_LINES = 32;
+
+char queue[QUEUE_LINES][LINE_LEN];
+size_t head = 0;  // next write slot
+size_t tail = 0;  // next read slot
+uint32_t dropped = 0;
+bool deferred = false;
+
+portMUX_TYPE logMux = portMUX_INITIALIZER_UNLOCKED;
+
+}  // namespace
+
+void logWrite(const char* fmt, ...) {
+  char line[LINE_LEN];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(line, sizeof(line), fmt, args);
+  va_end(args);
+
+  if (!deferred) {
+    Serial.println(line);
+    return;
+  }
+
+  portENTER_CRITICAL(&logMux);
+  size_t next = (head + 1) % QUEUE_LINES;
+  if (next == tail) {
+    dropped++;
+    portEXIT_CRITICAL(&logMux);
+    return;
+  }
+  memcpy(queue[head], line, LINE_LEN);
+  head = next;
+  portEXIT_CRITICAL(&logMux);
+}
+
+void logDrain(size_t maxLines) {
+  char line[LINE_LEN];
+  while (maxLines--) {
+    portENTER_CRITICAL(&logMux);
+    if (tail == head) {
+      portEXIT_CRITICAL(&logMux);
+      return;
+    }
+    memcpy(line, queue[tail], LINE_LEN);
+    tail = (tail + 1) % QUEUE_LINES;
+    portEXIT_CRITICAL(&logMux);
+
+    Serial.println(line);
+  }
+}
+
+void logEnableDeferred() {
+#if LOG_DEFERRED
+  deferred = true;
+#endif
+}
+
+uint32_t logDropped() {
+  return dropped;
+}
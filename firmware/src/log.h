@@ -0,0 +1,79 @@
+/**
+ * Compile-time leveled logging.
+ *
+ * The level is fixed at build time (-DLOG_LEVEL=n in platformio.ini),
+ * so statements above the configured level compile to nothing - zero
+ * code, zero cycles. No more hand-commenting Serial prints before a
+ * campaign.
+ *
+ *   0  ERROR  something is broken
+ *   1  WARN   degraded but running
+ *   2  INFO   lifecycle events (default)
+ *   3  TRACE  per-sample / per-frame detail
+ *
+ * With LOG_DEFERRED=1 (the default) enabled statements don't touch the
+ * UART on the calling path at all: lines are formatted into a small
+ * static ring and drained by the loop task when the sampler is idle.
+ * At 115200 baud one 80-char line takes ~7 ms - over half the 12.5 ms
+ * sample budget - so this matters. Until logEnableDeferred() is called
+ * (end of setup()) lines print directly, keeping boot output ordered.
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARN  1
+#define LOG_LEVEL_INFO  2
+#define LOG_LEVEL_TRACE 3
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#ifndef LOG_DEFERRED
+#define LOG_DEFERRED 1
+#endif
+
+/** Queue (or print) one formatted line. Not for direct use - go
+ *  through the LOG_* macros so disabled levels vanish entirely. */
+void logWrite(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/** Print up to maxLines queued lines. Call when the sampler is idle. */
+void logDrain(size_t maxLines);
+
+/** Switch from direct printing to queued mode (no-op unless built
+ *  with LOG_DEFERRED=1). */
+void logEnableDeferred();
+
+/** Lines dropped because the queue was full. */
+uint32_t logDropped();
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(fmt, ...) logWrite("E: " fmt, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(fmt, ...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(fmt, ...) logWrite("W: " fmt, ##__VA_ARGS__)
+#else
+#define LOG_WARN(fmt, ...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(fmt, ...) logWrite(fmt, ##__VA_ARGS__)
+#else
+#define LOG_INFO(fmt, ...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_TRACE
+#define LOG_TRACE(fmt, ...) logWrite("T: " fmt, ##__VA_ARGS__)
+#else
+#define LOG_TRACE(fmt, ...) ((void)0)
+#endif
+
+#endif  // LOG_H
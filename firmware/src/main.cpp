@@ -1,24 +1,2368 @@
 /**
- * Minimal test to verify ESP32 serial communication
- * Rename this to main.cpp to use it
+ * Rocket Motor Test Stand - ESP32-C3 Firmware
+ *
+ * PlatformIO Version
+ *
+ * Hardware:
+ * - ESP32-C3
+ * - HX711 Load Cell Amplifier
+ * - Load Cell
+ *
+ * Connections:
+ * - HX711 DT  -> GPIO 4
+ * - HX711 SCK -> GPIO 3
+ * - HX711 VCC -> 3.3V
+ * - HX711 GND -> GND
+ *
+ * Configuration lives in src/config.h (copy config.h.example).
  */
 
 #include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <ArduinoWebsockets.h>
+#include <ArduinoJson.h>
+#include <Preferences.h>
+#include <esp_timer.h>
+#include <esp_cpu.h>
+#include <esp_heap_caps.h>
+#include <esp_mac.h>
+#include <esp_task_wdt.h>
+
+#include "config.h"
+#include "wire_format.h"
+#include "ring_buffer.h"
+#include "blackbox.h"
+#include "filter.h"
+#include "hx711_multi.h"
+#include "hx711_spi.h"
+#include "live_stats.h"
+#include "log.h"
+#include "perf.h"
+
+// Defaults for options added after config.h.example was first copied,
+// so an existing config.h keeps working without edits.
+#ifndef BATCH_SIZE
+#define BATCH_SIZE 10
+#endif
+#ifndef BATCH_FLUSH_MS
+#define BATCH_FLUSH_MS 150
+#endif
+#ifndef SEND_RING_SECONDS
+#define SEND_RING_SECONDS 4
+#endif
+#ifndef PRETRIGGER_SECONDS
+#define PRETRIGGER_SECONDS 3
+#endif
+#ifndef HX711_CHANNEL_COUNT
+#define HX711_CHANNEL_COUNT 1
+#endif
+#ifndef HX711_DOUT_PINS
+#define HX711_DOUT_PINS {HX711_DOUT_PIN}
+#endif
+#ifndef HX711_USE_SPI
+#define HX711_USE_SPI 0
+#endif
+#ifndef RESEND_SECONDS
+#define RESEND_SECONDS 8
+#endif
+#ifndef BURN_THRESHOLD_N
+#define BURN_THRESHOLD_N 5.0
+#endif
+#ifndef HX711_RATE_PIN
+#define HX711_RATE_PIN -1
+#endif
+#ifndef IDLE_HEARTBEAT_HZ
+#define IDLE_HEARTBEAT_HZ 2
+#endif
+#ifndef AP_MODE
+#define AP_MODE 0
+#endif
+#ifndef AP_SSID
+#define AP_SSID "rocket-test-stand"
+#endif
+#ifndef AP_PASSWORD
+#define AP_PASSWORD "thrustcurve"
+#endif
+#ifndef AP_WS_PORT
+#define AP_WS_PORT 81
+#endif
+#ifndef WDT_TIMEOUT_S
+#define WDT_TIMEOUT_S 5
+#endif
+
+#if HX711_USE_SPI && HX711_CHANNEL_COUNT > 1
+#error "The SPI HX711 driver has one MISO; multi-channel stands use the parallel bit-bang driver (HX711_USE_SPI 0)"
+#endif
+
+using namespace websockets;
+
+// ============================================
+// GLOBAL VARIABLES
+// ============================================
+
+// Load cell channels: channel 0 is axial thrust, the rest side loads.
+// All chips share the SCK line and are clocked out in parallel, so the
+// blocking time per sample is the same whatever the channel count.
+// Single-cell stands can offload the clocking to the SPI peripheral
+// entirely (HX711_USE_SPI) - no interrupts-off window at all.
+static const uint8_t doutPins[HX711_CHANNEL_COUNT] = HX711_DOUT_PINS;
+#if HX711_USE_SPI
+using LoadCells = Hx711Spi;
+#else
+using LoadCells = Hx711Multi;
+#endif
+LoadCells cells;
+Preferences prefs;
+WebsocketsClient wsClient;
+Blackbox blackbox;
+
+enum State {
+  IDLE,
+  TESTING,
+  CALIBRATING
+};
+
+State currentState = IDLE;
+
+// Interrupt-driven acquisition: the HX711 pulls DOUT low the moment a
+// conversion is ready, so instead of polling wait_ready_retry() on a
+// millis() schedule (and inheriting jitter from whatever else the loop
+// is doing) an ISR on DOUT notifies a dedicated high-priority sampler
+// task that reads the word out immediately. The ISR timestamp, not the
+// read time, goes on the sample. Timestamps come from esp_timer (the
+// 64-bit microsecond clock): at 80 SPS a millisecond is 8% of a sample
+// period, far too coarse to align thrust data against high-speed video.
+// Samples carry the low 32 bits; the server unwraps across the ~71 min
+// rollover and maps device time to wall time via the time_sync
+// exchange below.
+volatile uint64_t sampleReadyAtUs = 0;
+
+// If no data-ready edge arrives for this long, something is wrong
+// (wiring, missed edge); fall back to one polled read and re-arm.
+const unsigned long SAMPLE_STALL_MS = 250;
+
+// Acquisition/network decoupling: the sampler task pushes into a
+// lock-free SPSC ring and the loop task drains it into the WebSocket.
+// A slow send (TCP retransmit, AP roam) backs data up in the ring
+// instead of stalling acquisition; the sampler task preempts the loop,
+// so it never waits on the network. Sized for several seconds at full
+// rate so a short outage loses nothing.
+struct Sample {
+  uint32_t timestamp_us;
+  int32_t raw[HX711_CHANNEL_COUNT];
+  float force_n[HX711_CHANNEL_COUNT];
+};
+
+static SpscRing<Sample, SAMPLE_RATE_HZ * SEND_RING_SECONDS> sampleRing;
+TaskHandle_t samplerTaskHandle = NULL;
+
+// Periodic ring health report (high-water mark, drops)
+const unsigned long STATS_INTERVAL_MS = 10000;
+unsigned long lastStatsTime = 0;
+
+// Hot-path cycle accounting (RISC-V mcycle CSR via esp_cpu_get_ccount).
+// Reported and reset with every stats frame, so the numbers are
+// per-interval. Single core, so the sampler task and loop() interleave
+// rather than run concurrently and plain accumulators are safe.
+CycleStats perfAcquire;  // HX711 clock-out into the ring
+CycleStats perfEncode;   // binary batch encode + resend bookkeeping
+CycleStats perfSend;     // network write (WebSocket or UDP)
+CycleStats perfPoll;     // wsClient.poll()
+LoopHistogram perfLoopHist;
+uint32_t perfDeadlineMisses = 0;  // sampler stall timeout fired
+
+#define PERF_BEGIN() uint32_t perf_c0_ = esp_cpu_get_ccount()
+#define PERF_END(stat) (stat).add(esp_cpu_get_ccount() - perf_c0_)
+
+// Adaptive sampling: the State machine drives both the chip and the
+// stream. The stands run on battery all day at the range, and paying
+// full 80 SPS acquisition plus streaming during the hours of IDLE
+// between burns is pure waste. With the HX711 RATE pin wired, IDLE
+// drops the chip itself to 10 SPS; entering TESTING (or CALIBRATING)
+// raises it back to 80 SPS before any data matters. On top of that,
+// IDLE transmits only a heartbeat subset (IDLE_HEARTBEAT_HZ) of the
+// acquired samples - enough for the dashboard's standby readout.
+// Note the pre-trigger ring fills at the idle rate, which also means
+// it spans proportionally more wall time; at 10 SPS the ignition
+// transient detail starts when the operator arms the test.
+const int HX711_SLOW_SPS = 10;
+int currentSampleHz = SAMPLE_RATE_HZ;
+uint8_t idleDivider = 1;
+uint8_t idlePhase = 0;
+
+// Send-path filter stage: runs on raw counts between the ring and the
+// network, per channel, with optional decimation so the live stream
+// can drop to what the dashboard plots without aliasing. The black-box
+// log and the live statistics stay full-rate and unfiltered; this
+// shapes only what goes over the air. Configured per test with the
+// set_filter command.
+FilterStage sendFilters[HX711_CHANNEL_COUNT];
+uint8_t sendDecimate = 1;   // send every Nth (filtered) sample
+uint8_t decimPhase = 0;
+
+// Streaming analysis during TESTING: running impulse integral, peak
+// thrust and burn edges on the axial channel, updated O(1) per sample
+// and summarized to the dashboard once a second. The authoritative
+// numbers still come from the server's post-test analysis; this is
+// for watching a burn go right (or wrong) in real time.
+LiveStats liveStats(BURN_THRESHOLD_N);
+const unsigned long LIVE_STATS_INTERVAL_MS = 1000;
+unsigned long lastLiveStatsTime = 0;
+
+// Host clock synchronization: a periodic three-message exchange
+// (time_sync -> time_sync_ack -> time_sync_result) gives the server a
+// device-to-wall-time offset with an RTT bound, so it can timestamp
+// samples in wall time with sub-millisecond error instead of trusting
+// receive time (which includes batching, WiFi and TCP queueing).
+const unsigned long TIME_SYNC_INTERVAL_MS = 5000;
+unsigned long lastTimeSyncTime = 0;
+
+// Non-blocking link management. The old connectWiFi() spun in a
+// delay(500) loop for up to 15 s from loop(), so a one-second AP blip
+// became a multi-second acquisition blackout. Reconnection is now a
+// state machine stepped once per loop pass: sampling and black-box
+// logging run at full rate throughout. The WebSocket connect attempt
+// itself is still a bounded blocking call (TCP connect + handshake),
+// but with WiFi already up that is tens of milliseconds, not seconds.
+enum LinkState {
+  LINK_UP,          // WiFi + WebSocket connected
+  LINK_WIFI_START,  // kick off association
+  LINK_WIFI_WAIT,   // association in progress
+  LINK_WS_CONNECT,  // WiFi up, WebSocket attempt due
+  LINK_BACKOFF      // failed attempt, wait before retrying
+};
+
+LinkState linkState = LINK_WIFI_START;
+
+#if AP_MODE
+// Field mode: we are the access point and the WebSocket server, and
+// the "link" is whoever walked up with a browser. The accepted
+// connection is assigned into the same global wsClient the rest of
+// the firmware streams to, so every send path works unchanged.
+WebsocketsServer apServer;
+// A phone has no dashboard at the range, so the device also serves
+// the self-contained viewer page over plain HTTP (field_page.h).
+#include "field_page.h"
+WiFiServer apHttpServer(80);
+#endif
+unsigned long linkStateSince = 0;
+const unsigned long WIFI_CONNECT_TIMEOUT_MS = 15000;
+const unsigned long LINK_BACKOFF_MS = 2000;
+
+// Reconnect latency accounting, readable from the server via stats
+unsigned long linkDownSince = 0;   // 0 = never been up / currently up
+uint32_t linkReconnects = 0;       // completed reconnect cycles
+uint32_t lastReconnectMs = 0;      // duration of the last outage
+bool linkEverUp = false;
+
+// Fast-reconnect cache, persisted in the same NVS namespace as the
+// calibration. Cold association (scan, DHCP, mDNS lookup of
+// SERVER_HOST) takes 4-8 s at the test site; reconnecting with the
+// cached BSSID + channel, the last negotiated IP config and the
+// resolved server address skips all three and completes well under a
+// second - inside what the send ring absorbs.
+struct NetCache {
+  bool valid;
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t netmask;
+  uint32_t dns;
+  uint32_t serverIp;  // 0 = unresolved
+};
+
+NetCache netCache = {};
+bool fastConnectActive = false;  // current attempt uses the cache
+bool fastConnectFailed = false;  // cache missed; stay cold until next success
+const unsigned long WIFI_FAST_TIMEOUT_MS = 3000;
+
+// Black-box upload: file records share the batch sample layout, so
+// upload streams them as ordinary batch frames, far faster than the
+// burn took to record.
+const size_t UPLOAD_BATCH_SAMPLES = 80;
+static uint8_t uploadBuf[wire::batchFrameSize(UPLOAD_BATCH_SAMPLES,
+                                               LoadCells::MAX_CHANNELS)];
+
+// Flow-controlled replay. uploadLog() streams synchronously inside
+// the command handler - fine for a short log, but a 10-minute test
+// blocks loop() for the whole transfer and pushes frames blind into
+// the socket buffers. The "replay" command runs from loop() instead:
+// up to REPLAY_WINDOW frames in flight, each further frame released
+// by the server's cumulative replay_ack, so the ack stream is the
+// backpressure. Completion reports the achieved throughput - a
+// degrading flash chip or a marginal RF path shows up as a number
+// that can be tracked across sessions.
+const uint32_t REPLAY_WINDOW = 4;
+bool replayActive = false;
+File replayFile;
+bool replayDelta = false;
+bool replayEof = false;
+uint8_t replayChannels = 0;
+float replayScale[LoadCells::MAX_CHANNELS];
+long replayOffsetCal[LoadCells::MAX_CHANNELS];
+char replayName[32];
+uint32_t replaySamples = 0;
+uint32_t replayFramesSent = 0;
+uint32_t replayFramesAcked = 0;
+uint32_t replayBytes = 0;
+uint32_t replayTs = 0;
+int32_t replayRaw[LoadCells::MAX_CHANNELS];
+unsigned long replayStartMs = 0;
+
+// Pre-trigger capture: everything before the operator clicks Start
+// used to be discarded - including the ignition transient we most
+// care about. While idle, the last PRETRIGGER_SECONDS of samples are
+// kept in an overwrite ring; the moment TESTING begins they are
+// prepended to the black-box log and replayed over the WebSocket, so
+// every test starts with DAQ-style pre-trigger history at zero
+// steady-state bandwidth cost.
+const size_t PRETRIGGER_CAPACITY = SAMPLE_RATE_HZ * PRETRIGGER_SECONDS;
+static Sample pretrigBuf[PRETRIGGER_CAPACITY];
+static size_t pretrigHead = 0;   // next write slot
+static size_t pretrigCount = 0;
+
+// Per-channel calibration (NVS keys "scale"/"offset" for channel 0 -
+// unchanged from the single-cell days - then "scale1", "offset1", ...)
+float calibration_scale[HX711_CHANNEL_COUNT];
+long calibration_offset[HX711_CHANNEL_COUNT];
+
+// Asynchronous tare/calibrate. The old handlers clocked the chip
+// themselves with blocking averaged reads plus a delay(500) - over a
+// second during which wsClient.poll() never ran and the server
+// declared the device dead. CALIBRATING now accumulates its averaging
+// samples through the normal interrupt-driven path and completes from
+// the drain loop, so command handling and keepalives stay live the
+// whole time. Averaging is free this way, so the windows are much
+// wider than the old 10 blocking reads.
+enum CalOp {
+  CAL_NONE,
+  CAL_TARE,   // new offsets for every channel
+  CAL_SCALE   // new scale factor for one channel, known mass applied
+};
+
+CalOp calOp = CAL_NONE;
+uint8_t calChannel = 0;
+float calKnownMass = 0.0f;
+uint16_t calTarget = 0;
+uint16_t calCollected = 0;
+uint16_t calSettle = 0;
+int64_t calSum[HX711_CHANNEL_COUNT];
+
+const uint16_t TARE_SAMPLES = 40;        // 0.5 s at full rate
+const uint16_t CALIBRATE_SAMPLES = 160;  // 2 s; was 10 blocking reads
+const uint16_t CAL_SETTLE_SAMPLES = 40;  // discarded while the mass settles
+
+// Deferred NVS persistence. A Preferences commit can stall for tens of
+// milliseconds while the flash cache is disabled; done inline from a
+// command handler right before ignition that is a sample gap. Setting
+// changes take effect in RAM immediately and only raise a bit here;
+// a low-priority step at the end of loop() commits one pending group
+// per pass, and only while the device is IDLE with the send ring
+// drained. New persisted settings get a bit and a writer function.
+const uint8_t PERSIST_CALIBRATION = 0x01;
+const uint8_t PERSIST_NET_CACHE = 0x02;
+const uint8_t PERSIST_DEVICE_ID = 0x04;
+uint8_t persistPending = 0;
+
+// Device identity for multi-stand deployments: several stands share
+// one server, so every message we originate names its sender. Stored
+// in the same NVS namespace as the calibration; until someone assigns
+// a friendlier name via set_device_id, the factory MAC keeps the
+// default unique across stands.
+char deviceId[24] = "";
+
+// Why this boot happened, captured once in setup(). Anything other
+// than power-on or a requested restart is a crash boot: setup() takes
+// the fast path and, if a black-box log was left open, resumes the
+// interrupted test.
+esp_reset_reason_t bootResetReason = ESP_RST_UNKNOWN;
+
+static const char* resetReasonName(esp_reset_reason_t r) {
+  switch (r) {
+    case ESP_RST_POWERON: return "poweron";
+    case ESP_RST_SW: return "sw";
+    case ESP_RST_PANIC: return "panic";
+    case ESP_RST_INT_WDT: return "int_wdt";
+    case ESP_RST_TASK_WDT: return "task_wdt";
+    case ESP_RST_WDT: return "wdt";
+    case ESP_RST_BROWNOUT: return "brownout";
+    case ESP_RST_DEEPSLEEP: return "deepsleep";
+    default: return "other";
+  }
+}
+
+// Wire format: JSON until the server opts in to binary via "set_format".
+enum WireFormat {
+  WIRE_JSON,
+  WIRE_BINARY
+};
+
+WireFormat wireFormat = WIRE_JSON;
+uint32_t sampleSeq = 0;
+
+// Retransmit buffer: every sample that leaves the device is kept in
+// an overwrite ring indexed by sequence number, so the server can
+// repair gaps after the fact with a "resend" command instead of us
+// re-running a motor. Resends always go over the WebSocket - the
+// whole point is reliability - regardless of the stream transport.
+const size_t RESEND_CAPACITY = SAMPLE_RATE_HZ * RESEND_SECONDS;
+struct SentSample {
+  uint32_t seq;
+  bool valid;
+  Sample sample;
+};
+static SentSample resendBuf[RESEND_CAPACITY];
+
+// Optional UDP stream transport, negotiated like the binary format.
+// TCP head-of-line blocking means one lost packet stalls every later
+// sample on the live trace; for monitoring, fresh-but-lossy beats
+// reliable-but-late. Batch frames (already sequence-numbered and
+// CRC-protected) go out as datagrams; the WebSocket stays up for
+// commands, stats and black-box upload, which is the reliable path
+// for the record of truth.
+WiFiUDP udp;
+bool udpTransport = false;
+uint16_t udpPort = 0;
+
+// Scratch buffer for all outbound JSON (hello, fallback readings,
+// stats, log list). Serializing into it instead of a heap String keeps
+// the send path allocation-free; on a part running for hours, heap
+// fragmentation from per-sample Strings is what ends endurance tests.
+static char jsonBuf[1024];
+
+// With -DALLOC_GUARD=1 the send path checks free heap around every
+// send and logs any shrinkage - a cheap way to prove the path stays
+// allocation-free after setup() completes.
+#if ALLOC_GUARD
+#define ALLOC_GUARD_BEGIN() uint32_t allocGuardHeap = esp_get_free_heap_size()
+#define ALLOC_GUARD_END(what)                                         \
+  do {                                                                \
+    uint32_t now = esp_get_free_heap_size();                          \
+    if (now < allocGuardHeap) {                                       \
+      LOG_ERROR("Heap allocation on " what " path: %lu bytes",        \
+                (unsigned long)(allocGuardHeap - now));               \
+    }                                                                 \
+  } while (0)
+#else
+#define ALLOC_GUARD_BEGIN() ((void)0)
+#define ALLOC_GUARD_END(what) ((void)0)
+#endif
+
+// With -DHEAP_AUDIT=1 (plus the -Wl,--wrap flags in platformio.ini)
+// every malloc/calloc/realloc after setup() returns is reported with
+// the caller's return address - addr2line turns that into the file and
+// line that broke the allocation-free steady state. The guard above
+// tells you that the send path allocated; this tells you who. Expect
+// WiFi/lwIP traffic in the report: the point of the audit is the full
+// picture, so it is a build mode, not an always-on check.
+#if HEAP_AUDIT
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* p, size_t size);
+}
+
+static volatile bool heapAuditArmed = false;
+static uint32_t heapAuditHits = 0;
+
+static void heapAuditReport(const char* fn, size_t size, void* caller) {
+  // esp_rom_printf, not LOG_*: callable from any context, allocates
+  // nothing. Capped so a chatty caller cannot flood the console.
+  heapAuditHits++;
+  if (heapAuditHits <= 100) {
+    esp_rom_printf("[heap-audit] %s(%u) from %p\n", fn, (unsigned)size,
+                   caller);
+  }
+}
+
+extern "C" void* __wrap_malloc(size_t size) {
+  if (heapAuditArmed) {
+    heapAuditReport("malloc", size, __builtin_return_address(0));
+  }
+  return __real_malloc(size);
+}
+
+extern "C" void* __wrap_calloc(size_t n, size_t size) {
+  if (heapAuditArmed) {
+    heapAuditReport("calloc", n * size, __builtin_return_address(0));
+  }
+  return __real_calloc(n, size);
+}
+
+extern "C" void* __wrap_realloc(void* p, size_t size) {
+  if (heapAuditArmed) {
+    heapAuditReport("realloc", size, __builtin_return_address(0));
+  }
+  return __real_realloc(p, size);
+}
+#endif
+
+// Sample accumulator: coalesces readings into one frame per batch so we
+// pay WebSocket+TCP framing once per BATCH_SIZE samples instead of per
+// sample. TESTING flushes every sample for the dashboard's live trace.
+static uint8_t batchBuf[wire::batchFrameSize(BATCH_SIZE, HX711_CHANNEL_COUNT)];
+static wire::BatchEncoder batchEncoder(batchBuf, BATCH_SIZE,
+                                       HX711_CHANNEL_COUNT);
+static bool batchOpen = false;
+static unsigned long batchStartMs = 0;
+
+// Delta compression (negotiated via hello/set_format): batches go out
+// as zigzag-varint deltas of the raw counts with the calibration in
+// the frame header, 3-5x smaller on real traces. The buffer is sized
+// for the worst case (every delta a full varint), which only happens
+// on noise-like data; typical frames are far smaller.
+static bool streamDelta = false;
+static uint8_t deltaBuf[wire::deltaBatchFrameSize(BATCH_SIZE,
+                                                  HX711_CHANNEL_COUNT)];
+static wire::DeltaBatchEncoder deltaEncoder(deltaBuf, BATCH_SIZE,
+                                            HX711_CHANNEL_COUNT);
+
+void flushBatch();
+
+// ============================================
+// FUNCTION DECLARATIONS
+// ============================================
+
+void stepLink();
+bool tryConnectWebSocket();
+void loadNetCache();
+void saveNetCache();
+void sendHello();
+void onMessageReceived(WebsocketsMessage msg);
+void samplerTask(void* arg);
+void acquireSample(uint64_t timestamp_us);
+static float countsToNewtons(int32_t raw, uint8_t channel);
+void sendSample(const Sample& sample);
+void sendStreamFrame(const uint8_t* buf, size_t len);
+void resendRange(uint32_t from, uint32_t count);
+void sendTimeSync();
+void sendRingStats();
+void sendLiveStats();
+void sendLogList();
+void flushPretrigger();
+void uploadLog(const char* name);
+void startReplay(const char* name);
+void replayStep();
+void deleteLog(const char* name);
+void armSampleInterrupt();
+void setSampleRate(bool fast);
+void handleTare();
+void handleCalibrate(float known_mass_g, uint8_t channel);
+void handleStartTest();
+void handleStopTest();
+void handleBinaryCommand(const uint8_t* data, size_t len);
+void startCalibration(CalOp op, uint8_t channel, float known_mass_g,
+                      uint16_t samples);
+void feedCalibration(const Sample& sample);
+void finishCalibration();
+void loadCalibration();
+void saveCalibration();
+void writeCalibrationNvs();
+void writeNetCacheNvs();
+void loadDeviceId();
+void writeDeviceIdNvs();
+void persistStep();
+void recoverCrashedLog(bool resume);
+void setStatusLED(bool on);
+
+// ============================================
+// SETUP
+// ============================================
 
 void setup() {
+  bootResetReason = esp_reset_reason();
+  bool crashBoot = (bootResetReason == ESP_RST_PANIC ||
+                    bootResetReason == ESP_RST_INT_WDT ||
+                    bootResetReason == ESP_RST_TASK_WDT ||
+                    bootResetReason == ESP_RST_WDT ||
+                    bootResetReason == ESP_RST_BROWNOUT);
+
+  // Watchdog over the loop task, armed before anything slow: a hang
+  // anywhere after this line resets the device into the crash-boot
+  // path instead of sitting dead next to a burning motor
+  esp_task_wdt_init(WDT_TIMEOUT_S, true);
+  esp_task_wdt_add(NULL);
+
   Serial.begin(115200);
-  delay(2000);  // Wait for serial to stabilize
+  if (!crashBoot) {
+    // Operator time to attach a monitor. After a mid-burn reset every
+    // millisecond is data, so the crash path skips it
+    delay(1000);
+  }
 
   Serial.println("\n\n=================================");
-  Serial.println("ESP32 Serial Test - SUCCESS!");
+  Serial.println("Rocket Motor Test Stand - ESP32");
   Serial.println("=================================\n");
+  LOG_INFO("Reset reason: %s", resetReasonName(bootResetReason));
+
+  // Initialize status LED
+  #if USE_STATUS_LED
+    pinMode(STATUS_LED_PIN, OUTPUT);
+    digitalWrite(STATUS_LED_PIN, LOW);
+  #endif
+
+  // Initialize HX711 channels (shared SCK, parallel clocking)
+  LOG_INFO("Initializing %d HX711 channel(s) (SCK: %d)...",
+           HX711_CHANNEL_COUNT, HX711_SCK_PIN);
+
+  cells.begin(HX711_SCK_PIN, doutPins, HX711_CHANNEL_COUNT);
+  cells.setGain(128);
+
+#if HX711_RATE_PIN >= 0
+  pinMode(HX711_RATE_PIN, OUTPUT);
+#endif
+  setSampleRate(false);  // IDLE: slow conversions, heartbeat streaming
+
+  if (cells.waitReady(1000)) {
+    LOG_INFO("HX711 initialized successfully");
+  } else {
+    LOG_ERROR("HX711 not found! Check wiring and try again");
+  }
+
+  // Load calibration and our name on the shared server
+  loadCalibration();
+  loadDeviceId();
+
+  // Load the WiFi fast-reconnect cache
+  loadNetCache();
+
+  // Mount flash for black-box logging
+  blackbox.begin();
+
+  // A log left open by a mid-test reset gets its header patched so it
+  // uploads whole; after a crash boot the interrupted test resumes
+  // recording right here - before the network is even up - and the
+  // link state machine catches the stream up later
+  recoverCrashedLog(crashBoot);
+
+#if AP_MODE
+  // Field mode: stand up our own network, the WebSocket server, and
+  // the HTTP server that hands out the viewer page; viewers connect
+  // to us via the link step in loop()
+  WiFi.mode(WIFI_AP);
+  WiFi.softAP(AP_SSID, AP_PASSWORD);
+  apServer.listen(AP_WS_PORT);
+  apHttpServer.begin();
+  LOG_INFO("AP mode: SSID " AP_SSID ", viewer at http://%s/",
+           WiFi.softAPIP().toString().c_str());
+#else
+  // WiFi and the WebSocket come up via the link state machine in
+  // loop(); acquisition does not wait for the network.
+#endif
+
+  // Start the sampler task (arms the DOUT interrupt itself). Higher
+  // priority than the Arduino loop task so acquisition preempts sends.
+  xTaskCreate(samplerTask, "sampler", 4096, NULL, 3, &samplerTaskHandle);
+
+  Serial.println("\nSetup complete. Ready to stream data.\n");
+
+  // From here on, log lines queue up and drain when the sampler is idle
+  logEnableDeferred();
+#if HEAP_AUDIT
+  heapAuditArmed = true;  // everything below this line should be static
+#endif
+  setStatusLED(true);
 }
 
+// ============================================
+// MAIN LOOP
+// ============================================
+
 void loop() {
-  static int count = 0;
+  uint32_t loopStartCycles = esp_cpu_get_ccount();
+
+  // Every pass through here proves the loop task is alive
+  esp_task_wdt_reset();
+
+  // Keep the link up without ever blocking acquisition
+  stepLink();
+
+  // Process WebSocket messages
+  if (wsClient.available()) {
+    PERF_BEGIN();
+    wsClient.poll();
+    PERF_END(perfPoll);
+  }
+
+  // Flush a batch that aged out without reaching its count threshold
+  if (batchOpen && (millis() - batchStartMs) >= BATCH_FLUSH_MS) {
+    flushBatch();
+  }
+
+  // Drain queued samples: black-box log first (record of truth), then
+  // best-effort live streaming. Acquisition keeps running in the
+  // sampler task even if a send or flash write here blocks. Outside a
+  // test the sample also lands in the pre-trigger ring.
+  Sample sample;
+  while (sampleRing.pop(sample)) {
+    if (currentState == CALIBRATING && calOp != CAL_NONE) {
+      feedCalibration(sample);
+    }
+
+    if (blackbox.isLogging()) {
+      blackbox.log(sample.timestamp_us, sample.raw);
+      liveStats.update(sample.timestamp_us, sample.force_n[0]);
+    } else {
+      pretrigBuf[pretrigHead] = sample;
+      pretrigHead = (pretrigHead + 1) % PRETRIGGER_CAPACITY;
+      if (pretrigCount < PRETRIGGER_CAPACITY) {
+        pretrigCount++;
+      }
+    }
+
+    // The live stream pauses while a stored log replays over this
+    // socket: interleaved live batch frames would be folded into the
+    // replayed test by the server and acked against the replay window.
+    // Samples still reached the pre-trigger ring / black box above.
+    if (replayActive) {
+      continue;
+    }
+
+    // IDLE heartbeat: off-test the dashboard needs a standby readout,
+    // not the full rate; every sample still reached the pre-trigger
+    // ring above
+    if (currentState == IDLE && !blackbox.isLogging()) {
+      if (++idlePhase < idleDivider) {
+        continue;
+      }
+      idlePhase = 0;
+    }
+
+    // The live stream gets the (optional) filter and decimation; the
+    // log and stats above saw the untouched full-rate sample
+    Sample out = sample;
+    for (uint8_t ch = 0; ch < HX711_CHANNEL_COUNT; ch++) {
+      out.raw[ch] = sendFilters[ch].apply(sample.raw[ch]);
+      if (out.raw[ch] != sample.raw[ch]) {
+        out.force_n[ch] = countsToNewtons(out.raw[ch], ch);
+      }
+    }
+    if (++decimPhase >= sendDecimate) {
+      decimPhase = 0;
+      sendSample(out);
+    }
+  }
+
+  // Periodic ring health report so overflow headroom is visible
+  if (millis() - lastStatsTime >= STATS_INTERVAL_MS) {
+    lastStatsTime = millis();
+    sendRingStats();
+  }
+
+#if !AP_MODE
+  // Keep the server's device-clock-to-wall-time estimate fresh (a
+  // browser viewer in AP mode has no clock exchange to answer)
+  if (linkState == LINK_UP && millis() - lastTimeSyncTime >= TIME_SYNC_INTERVAL_MS) {
+    lastTimeSyncTime = millis();
+    sendTimeSync();
+  }
+#endif
+
+  // Live analysis summary while a test is running
+  if (currentState == TESTING &&
+      millis() - lastLiveStatsTime >= LIVE_STATS_INTERVAL_MS) {
+    lastLiveStatsTime = millis();
+    sendLiveStats();
+  }
+
+  // Deferred NVS commits, only off-test with the ring drained
+  persistStep();
+
+  // Flow-controlled log replay, one ack window per pass
+  replayStep();
+
+  // Drain deferred log lines only while the sampler is idle
+  if (sampleRing.empty()) {
+    logDrain(4);
+  }
+
+  perfLoopHist.add(esp_cpu_get_ccount() - loopStartCycles);
+}
+
+// ============================================
+// ACQUISITION
+// ============================================
+
+void IRAM_ATTR onHX711DataReady() {
+  // DOUT doubles as the serial data line and toggles while the word is
+  // clocked out, so disarm until the read completes.
+  detachInterrupt(digitalPinToInterrupt(doutPins[0]));
+  sampleReadyAtUs = (uint64_t)esp_timer_get_time();
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(samplerTaskHandle, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+void samplerTask(void* arg) {
+  armSampleInterrupt();
+
+  for (;;) {
+    // Block until the ISR signals a completed conversion, with a stall
+    // timeout in case an edge is ever lost
+    uint32_t notified = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SAMPLE_STALL_MS));
+
+    if (notified) {
+      acquireSample(sampleReadyAtUs);
+      armSampleInterrupt();
+    } else {
+      // Missed edge or wiring glitch - one polled read, then re-arm
+      perfDeadlineMisses++;
+      if (cells.waitReady(30)) {
+        acquireSample((uint64_t)esp_timer_get_time());
+      } else {
+        LOG_WARN("HX711 not ready");
+      }
+      armSampleInterrupt();
+    }
+  }
+}
+
+static float countsToNewtons(int32_t raw, uint8_t channel) {
+  float mass_grams =
+      (raw - calibration_offset[channel]) / calibration_scale[channel];
+  return (mass_grams / 1000.0) * 9.81;
+}
+
+void acquireSample(uint64_t timestamp_us) {
+  // The ISR fires on channel 0; the other chips free-run at the same
+  // nominal rate, so give stragglers a moment to finish converting
+  // before the parallel clock-out.
+#if HX711_CHANNEL_COUNT > 1
+  if (!cells.waitReady(3)) {
+    LOG_WARN("HX711 channel lagging; sample skipped");
+    return;
+  }
+#endif
+
+  Sample sample;
+  sample.timestamp_us = (uint32_t)timestamp_us;  // low 32 bits on the wire
+
+  PERF_BEGIN();
+  cells.readAll(sample.raw);
+  PERF_END(perfAcquire);
+
+  for (uint8_t ch = 0; ch < HX711_CHANNEL_COUNT; ch++) {
+    sample.force_n[ch] = countsToNewtons(sample.raw[ch], ch);
+  }
+
+  LOG_TRACE("Raw: %ld, Force: %.2fN", (long)sample.raw[0],
+            sample.force_n[0]);
+
+  // Never blocks: a full ring counts a drop instead
+  sampleRing.push(sample);
+}
+
+void armSampleInterrupt() {
+  attachInterrupt(digitalPinToInterrupt(doutPins[0]), onHX711DataReady, FALLING);
+  // If the conversion finished before we re-armed, we already missed
+  // the falling edge - treat it as ready now.
+  if (digitalRead(doutPins[0]) == LOW) {
+    detachInterrupt(digitalPinToInterrupt(doutPins[0]));
+    sampleReadyAtUs = (uint64_t)esp_timer_get_time();
+    xTaskNotifyGive(samplerTaskHandle);
+  }
+}
+
+void setSampleRate(bool fast) {
+#if HX711_RATE_PIN >= 0
+  // RATE high = 80 SPS, low = 10 SPS; the chip needs a few conversions
+  // to settle after switching, which the state transitions absorb
+  digitalWrite(HX711_RATE_PIN, fast ? HIGH : LOW);
+  currentSampleHz = fast ? SAMPLE_RATE_HZ : HX711_SLOW_SPS;
+#else
+  // RATE not wired: the chip stays at its strapped rate and only the
+  // transmit side throttles
+  currentSampleHz = SAMPLE_RATE_HZ;
+#endif
+
+  idleDivider = (uint8_t)(currentSampleHz / IDLE_HEARTBEAT_HZ);
+  if (idleDivider < 1) {
+    idleDivider = 1;
+  }
+  idlePhase = 0;
+  LOG_INFO("Sample rate: %d SPS (idle heartbeat divider %u)",
+           currentSampleHz, idleDivider);
+}
+
+// ============================================
+// LINK STATE MACHINE
+// ============================================
+
+#if AP_MODE
+// One page, one route: any HTTP request gets the embedded viewer.
+// Requests are tiny and rare (one phone walking up), so reading the
+// request line synchronously is fine next to the 5 s watchdog.
+static void serveFieldPage() {
+  WiFiClient http = apHttpServer.available();
+  if (!http) {
+    return;
+  }
+  unsigned long start = millis();
+  while (http.connected() && millis() - start < 250) {
+    if (http.available() && http.read() == '\n') {
+      break;  // request line seen; headers don't matter
+    }
+  }
+  http.print("HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n"
+             "Connection: close\r\n\r\n");
+  http.print(FIELD_PAGE);
+  http.stop();
+}
+#endif
+
+void stepLink() {
+#if AP_MODE
+  serveFieldPage();
+  if (linkState == LINK_UP && !wsClient.available()) {
+    LOG_WARN("Viewer disconnected");
+    setStatusLED(false);
+    batchOpen = false;
+    linkState = LINK_WS_CONNECT;
+  }
+  if (apServer.poll()) {
+    wsClient = apServer.accept();
+    wsClient.onMessage(onMessageReceived);
+    // No hello/set_format negotiation with a browser: binary frames
+    // over the WebSocket, decoded by the viewer page (field_page.h)
+    // the device itself serves over HTTP
+    wireFormat = WIRE_BINARY;
+    udpTransport = false;
+    batchOpen = false;
+    setStatusLED(true);
+    linkState = LINK_UP;
+    LOG_INFO("Viewer connected");
+  }
+  return;
+#endif
+
+  bool wifiUp = (WiFi.status() == WL_CONNECTED);
+
+  switch (linkState) {
+    case LINK_UP:
+      if (!wifiUp) {
+        LOG_WARN("WiFi disconnected. Reconnecting...");
+        setStatusLED(false);
+        linkDownSince = millis();
+        batchOpen = false;
+        linkState = LINK_WIFI_START;
+      } else if (!wsClient.available()) {
+        LOG_WARN("WebSocket disconnected. Reconnecting...");
+        setStatusLED(false);
+        linkDownSince = millis();
+        batchOpen = false;
+        linkState = LINK_WS_CONNECT;
+      }
+      break;
+
+    case LINK_WIFI_START:
+      WiFi.mode(WIFI_STA);
+      if (netCache.valid && !fastConnectFailed) {
+        // Skip scan and DHCP: directed association on the cached
+        // BSSID/channel with the last negotiated address
+        LOG_INFO("Fast WiFi connect to %s (cached BSSID, ch %u)", WIFI_SSID,
+                 netCache.channel);
+        WiFi.config(IPAddress(netCache.ip), IPAddress(netCache.gateway),
+                    IPAddress(netCache.netmask), IPAddress(netCache.dns));
+        WiFi.begin(WIFI_SSID, WIFI_PASSWORD, netCache.channel, netCache.bssid);
+        fastConnectActive = true;
+      } else {
+        LOG_INFO("Connecting to WiFi: %s", WIFI_SSID);
+        WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);  // back to DHCP
+        WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+        fastConnectActive = false;
+      }
+      linkStateSince = millis();
+      linkState = LINK_WIFI_WAIT;
+      break;
+
+    case LINK_WIFI_WAIT:
+      if (wifiUp) {
+        LOG_INFO("WiFi connected! IP: %s, RSSI: %d dBm",
+                 WiFi.localIP().toString().c_str(), WiFi.RSSI());
+        fastConnectFailed = false;
+        linkState = LINK_WS_CONNECT;
+      } else if (fastConnectActive &&
+                 millis() - linkStateSince >= WIFI_FAST_TIMEOUT_MS) {
+        // AP moved channel or was replaced - fall back to a full scan
+        LOG_WARN("Fast connect missed; falling back to full association");
+        fastConnectFailed = true;
+        WiFi.disconnect();
+        linkState = LINK_WIFI_START;
+      } else if (millis() - linkStateSince >= WIFI_CONNECT_TIMEOUT_MS) {
+        LOG_ERROR("WiFi association timed out - check SSID and password");
+        WiFi.disconnect();
+        linkStateSince = millis();
+        linkState = LINK_BACKOFF;
+      }
+      break;
+
+    case LINK_WS_CONNECT:
+      if (tryConnectWebSocket()) {
+        saveNetCache();  // association + resolution known good
+        setStatusLED(true);
+        if (linkEverUp && linkDownSince != 0) {
+          lastReconnectMs = (uint32_t)(millis() - linkDownSince);
+          linkReconnects++;
+          LOG_INFO("Link restored after %lu ms", (unsigned long)lastReconnectMs);
+        }
+        linkDownSince = 0;
+        linkEverUp = true;
+        linkState = LINK_UP;
+      } else {
+        linkStateSince = millis();
+        linkState = LINK_BACKOFF;
+      }
+      break;
+
+    case LINK_BACKOFF:
+      if (millis() - linkStateSince >= LINK_BACKOFF_MS) {
+        linkState = wifiUp ? LINK_WS_CONNECT : LINK_WIFI_START;
+      }
+      break;
+  }
+}
+
+// ============================================
+// WEBSOCKET FUNCTIONS
+// ============================================
+
+bool tryConnectWebSocket() {
+  // Resolve SERVER_HOST once and cache the address; mDNS lookups at
+  // the test site cost seconds we do not have mid-burn
+  IPAddress serverIp;
+  if (netCache.serverIp != 0) {
+    serverIp = IPAddress(netCache.serverIp);
+  } else if (WiFi.hostByName(SERVER_HOST, serverIp) != 1) {
+    LOG_ERROR("Cannot resolve %s", SERVER_HOST);
+    return false;
+  } else {
+    LOG_INFO("Resolved %s -> %s", SERVER_HOST, serverIp.toString().c_str());
+    netCache.serverIp = (uint32_t)serverIp;
+  }
+
+  LOG_INFO("Connecting to WebSocket server: %s:%d",
+           serverIp.toString().c_str(), SERVER_PORT);
+
+  static char url[96];
+  snprintf(url, sizeof(url), "ws://%s:%d/esp32", serverIp.toString().c_str(),
+           SERVER_PORT);
+
+  wsClient.onMessage(onMessageReceived);
+
+  // A TCP connect to an unreachable server can out-wait the watchdog
+  // window. This is the one blocking wait we expect, so it runs
+  // unsupervised - everything around it stays under the watchdog
+  esp_task_wdt_delete(NULL);
+  bool connected = wsClient.connect(url);
+  esp_task_wdt_add(NULL);
+
+  if (connected) {
+    LOG_INFO("WebSocket connected!");
+    // Every new connection starts in JSON over the WebSocket until
+    // the server opts in again.
+    wireFormat = WIRE_JSON;
+    udpTransport = false;
+    batchOpen = false;
+    sendHello();
+  } else {
+    LOG_ERROR("WebSocket connection failed - check server IP and port");
+    // The server may have moved; force re-resolution next attempt
+    netCache.serverIp = 0;
+  }
+  return connected;
+}
+
+void sendHello() {
+  // Announce supported wire formats; the server replies with set_format.
+  StaticJsonDocument<256> doc;
+  doc["type"] = "hello";
+  doc["device"] = deviceId;
+  doc["wire_version"] = wire::VERSION;
+  doc["reset_reason"] = resetReasonName(bootResetReason);
+  JsonArray formats = doc.createNestedArray("formats");
+  formats.add("json");
+  formats.add("binary");
+  JsonArray transports = doc.createNestedArray("transports");
+  transports.add("websocket");
+  transports.add("udp");
+  JsonArray compressions = doc.createNestedArray("compressions");
+  compressions.add("delta");
+
+  serializeJson(doc, jsonBuf, sizeof(jsonBuf));
+  wsClient.send(jsonBuf);
+}
+
+// The hot commands arrive as compact binary frames (opcode + fixed
+// payload + CRC, see wire_format.h) dispatched through this table -
+// no JSON parse between an abort on the radio and the state change.
+// The JSON path below stays for everything configuration-shaped and
+// for servers that never upgraded; a content sniff on the first byte
+// routes each message.
+static void cmdStopTest(const uint8_t*) { handleStopTest(); }
+static void cmdStartTest(const uint8_t*) { handleStartTest(); }
+static void cmdTare(const uint8_t*) { handleTare(); }
+static void cmdCalibrate(const uint8_t* p) {
+  handleCalibrate(wire::getFloat(p), p[4]);
+}
+static void cmdResend(const uint8_t* p) {
+  resendRange(wire::getU32(p), wire::getU16(p + 4));
+}
+
+struct CommandEntry {
+  uint8_t opcode;
+  uint8_t payloadLen;
+  void (*handler)(const uint8_t* payload);
+};
+
+// stop_test first: the abort path matches on the first compare
+static const CommandEntry commandTable[] = {
+    {wire::CMD_STOP_TEST, 0, cmdStopTest},
+    {wire::CMD_START_TEST, 0, cmdStartTest},
+    {wire::CMD_TARE, 0, cmdTare},
+    {wire::CMD_CALIBRATE, 5, cmdCalibrate},
+    {wire::CMD_RESEND, 6, cmdResend},
+};
+
+void handleBinaryCommand(const uint8_t* data, size_t len) {
+  if (len < wire::commandFrameSize(0) || data[0] != wire::MAGIC0 ||
+      data[1] != wire::MAGIC1 || data[2] != wire::VERSION ||
+      data[3] != wire::FRAME_COMMAND) {
+    LOG_WARN("Malformed command frame (%u bytes)", (unsigned)len);
+    return;
+  }
+  if (wire::crc16(data, len - 2) != wire::getU16(data + len - 2)) {
+    LOG_WARN("Command frame CRC mismatch");
+    return;
+  }
+
+  uint8_t opcode = data[4];
+  for (const CommandEntry& entry : commandTable) {
+    if (entry.opcode == opcode) {
+      if (len != wire::commandFrameSize(entry.payloadLen)) {
+        LOG_WARN("Command 0x%02X wrong length %u", opcode, (unsigned)len);
+        return;
+      }
+      entry.handler(data + wire::COMMAND_HEADER_SIZE);
+      return;
+    }
+  }
+  LOG_WARN("Unknown command opcode 0x%02X", opcode);
+}
+
+void onMessageReceived(WebsocketsMessage msg) {
+  // Binary command frames skip JSON entirely; the magic byte doubles
+  // as the content sniff since JSON text starts with '{'
+  const WSString& raw = msg.rawData();
+  if (msg.isBinary() ||
+      (!raw.empty() && (uint8_t)raw[0] == wire::MAGIC0)) {
+    handleBinaryCommand((const uint8_t*)raw.data(), raw.size());
+    return;
+  }
+
+  LOG_INFO("Received command: %s", msg.data().c_str());
+
+  StaticJsonDocument<256> doc;
+  DeserializationError error = deserializeJson(doc, msg.data());
+
+  if (error) {
+    LOG_WARN("JSON parse error: %s", error.c_str());
+    return;
+  }
+
+  const char* type = doc["type"];
+
+  if (strcmp(type, "tare") == 0) {
+    handleTare();
+  }
+  else if (strcmp(type, "calibrate") == 0) {
+    float known_mass = doc["known_mass"];
+    uint8_t channel = doc["channel"] | 0;  // axial cell unless specified
+    handleCalibrate(known_mass, channel);
+  }
+  else if (strcmp(type, "start_test") == 0) {
+    handleStartTest();
+  }
+  else if (strcmp(type, "stop_test") == 0) {
+    handleStopTest();
+  }
+  else if (strcmp(type, "list_logs") == 0) {
+    sendLogList();
+  }
+  else if (strcmp(type, "upload_log") == 0) {
+    const char* file = doc["file"];
+    if (file) {
+      uploadLog(file);
+    }
+  }
+  else if (strcmp(type, "replay") == 0) {
+    const char* file = doc["file"];
+    if (file) {
+      startReplay(file);
+    }
+  }
+  else if (strcmp(type, "replay_ack") == 0) {
+    // Cumulative frames the server has taken in; reopens the window.
+    // Clamped to what we actually sent: an over-count (e.g. a stray
+    // frame the server attributed to the replay) must not drive the
+    // unsigned window arithmetic in replayStep() negative.
+    uint32_t frames = doc["frames"];
+    if (frames > replayFramesSent) {
+      frames = replayFramesSent;
+    }
+    if (replayActive && frames > replayFramesAcked) {
+      replayFramesAcked = frames;
+    }
+  }
+  else if (strcmp(type, "delete_log") == 0) {
+    const char* file = doc["file"];
+    if (file) {
+      deleteLog(file);
+    }
+  }
+  else if (strcmp(type, "set_filter") == 0) {
+    const char* mode = doc["mode"] | "none";
+    sendDecimate = doc["decimate"] | 1;
+    if (sendDecimate < 1) {
+      sendDecimate = 1;
+    }
+    decimPhase = 0;
+    if (strcmp(mode, "median") == 0) {
+      uint8_t n = doc["n"] | 5;
+      for (uint8_t ch = 0; ch < HX711_CHANNEL_COUNT; ch++) {
+        sendFilters[ch].setMedian(n);
+      }
+      LOG_INFO("Send filter: median-of-%u, decimate %u", n, sendDecimate);
+    } else if (strcmp(mode, "lowpass") == 0) {
+      float cutoff = doc["cutoff"] | 10.0f;
+      for (uint8_t ch = 0; ch < HX711_CHANNEL_COUNT; ch++) {
+        sendFilters[ch].setLowpass(cutoff, SAMPLE_RATE_HZ);
+      }
+      LOG_INFO("Send filter: lowpass %.1f Hz, decimate %u", cutoff,
+               sendDecimate);
+    } else {
+      for (uint8_t ch = 0; ch < HX711_CHANNEL_COUNT; ch++) {
+        sendFilters[ch].setNone();
+      }
+      LOG_INFO("Send filter: none, decimate %u", sendDecimate);
+    }
+  }
+  else if (strcmp(type, "resend") == 0) {
+    uint32_t from = doc["from"];
+    uint32_t count = doc["count"] | 1;
+    resendRange(from, count);
+  }
+  else if (strcmp(type, "time_sync_ack") == 0) {
+    // Final leg of the sync exchange: report when the ack arrived on
+    // our clock. The server remembers its own send time per t0, so
+    // nothing lossy (no wall-clock floats) crosses the link.
+    StaticJsonDocument<128> out;
+    out["type"] = "time_sync_result";
+    out["device"] = deviceId;
+    out["t0"] = doc["t0"].as<uint32_t>();
+    out["t2"] = (uint32_t)esp_timer_get_time();
+    serializeJson(out, jsonBuf, sizeof(jsonBuf));
+    wsClient.send(jsonBuf);
+  }
+  else if (strcmp(type, "set_format") == 0) {
+    const char* format = doc["format"];
+    if (format && strcmp(format, "binary") == 0) {
+      wireFormat = WIRE_BINARY;
+      LOG_INFO("Wire format: binary");
+    } else {
+      wireFormat = WIRE_JSON;
+      LOG_INFO("Wire format: json");
+    }
+    const char* transport = doc["transport"];
+    if (wireFormat == WIRE_BINARY && transport &&
+        strcmp(transport, "udp") == 0) {
+      udpPort = doc["port"] | 5005;
+      udpTransport = true;
+      LOG_INFO("Stream transport: UDP to port %u", udpPort);
+    } else {
+      udpTransport = false;
+    }
+    const char* compression = doc["compression"];
+    streamDelta = (wireFormat == WIRE_BINARY && compression &&
+                   strcmp(compression, "delta") == 0);
+    batchOpen = false;  // any half-built frame is in the other format
+    if (streamDelta) {
+      LOG_INFO("Stream compression: delta");
+    }
+  }
+  else if (strcmp(type, "set_device_id") == 0) {
+    // Rename for the bench label printer; takes effect immediately,
+    // the NVS write follows from persistStep()
+    const char* id = doc["device"];
+    if (id && id[0] != '\0') {
+      snprintf(deviceId, sizeof(deviceId), "%s", id);
+      persistPending |= PERSIST_DEVICE_ID;
+      LOG_INFO("Device ID set to %s", deviceId);
+    }
+  }
+  else {
+    LOG_WARN("Unknown command: %s", type);
+  }
+}
+
+// ============================================
+// DATA FUNCTIONS
+// ============================================
+
+static void rememberSent(uint32_t seq, const Sample& sample) {
+  SentSample& slot = resendBuf[seq % RESEND_CAPACITY];
+  slot.seq = seq;
+  slot.valid = true;
+  slot.sample = sample;
+}
+
+void sendSample(const Sample& sample) {
+  if (wireFormat == WIRE_BINARY) {
+    // Accumulate into the batch frame; flush on count, age, or when the
+    // live trace needs every sample immediately.
+    PERF_BEGIN();
+    if (!batchOpen) {
+      if (streamDelta) {
+        deltaEncoder.begin(sampleSeq, calibration_scale, calibration_offset);
+      } else {
+        batchEncoder.begin(sampleSeq);
+      }
+      batchOpen = true;
+      batchStartMs = millis();
+    }
+    if (streamDelta) {
+      deltaEncoder.add(sample.timestamp_us, sample.raw);
+    } else {
+      batchEncoder.add(sample.timestamp_us, sample.raw, sample.force_n);
+    }
+    rememberSent(sampleSeq, sample);
+    sampleSeq++;
+    PERF_END(perfEncode);
+
+    bool forceFlush = (currentState == TESTING) || (BATCH_SIZE <= 1);
+    bool ageFlush = (millis() - batchStartMs) >= BATCH_FLUSH_MS;
+    bool batchFull = streamDelta ? deltaEncoder.full() : batchEncoder.full();
+    if (forceFlush || ageFlush || batchFull) {
+      flushBatch();
+    }
+  } else {
+    // JSON fallback for servers that never sent set_format.
+    ALLOC_GUARD_BEGIN();
+    StaticJsonDocument<256> doc;
+    doc["type"] = "reading";
+    doc["device"] = deviceId;
+    doc["seq"] = sampleSeq;
+    doc["timestamp"] = sample.timestamp_us / 1000;  // legacy servers expect ms
+    doc["timestamp_us"] = sample.timestamp_us;
+    doc["force"] = round(sample.force_n[0] * 100) / 100.0;
+    doc["raw"] = sample.raw[0];
+#if HX711_CHANNEL_COUNT > 1
+    JsonArray forces = doc.createNestedArray("forces");
+    JsonArray raws = doc.createNestedArray("raws");
+    for (uint8_t ch = 0; ch < HX711_CHANNEL_COUNT; ch++) {
+      forces.add(round(sample.force_n[ch] * 100) / 100.0);
+      raws.add(sample.raw[ch]);
+    }
+#endif
+
+    serializeJson(doc, jsonBuf, sizeof(jsonBuf));
+    wsClient.send(jsonBuf);
+    rememberSent(sampleSeq, sample);
+    sampleSeq++;
+    ALLOC_GUARD_END("json reading");
+  }
+}
+
+void sendTimeSync() {
+  // First leg: just our transmit time. The server stamps its receive
+  // and reply times and answers with time_sync_ack carrying t0 back.
+  StaticJsonDocument<128> doc;
+  doc["type"] = "time_sync";
+  doc["device"] = deviceId;
+  doc["t0"] = (uint32_t)esp_timer_get_time();
+
+  serializeJson(doc, jsonBuf, sizeof(jsonBuf));
+  wsClient.send(jsonBuf);
+}
+
+void sendLiveStats() {
+  StaticJsonDocument<256> doc;
+  doc["type"] = "live_stats";
+  doc["device"] = deviceId;
+  doc["impulse_ns"] = liveStats.impulseNs();
+  doc["peak_n"] = liveStats.peakForce();
+  doc["peak_t_us"] = liveStats.peakAtUs();
+  doc["samples"] = liveStats.sampleCount();
+  if (liveStats.burnStarted()) {
+    doc["burn_start_us"] = liveStats.burnStartUs();
+  }
+  if (liveStats.burnEnded()) {
+    doc["burn_end_us"] = liveStats.burnEndUs();
+  }
+
+  serializeJson(doc, jsonBuf, sizeof(jsonBuf));
+  wsClient.send(jsonBuf);
+}
+
+static void addPerfSection(JsonObject& parent, const char* name,
+                           const CycleStats& stats) {
+  JsonObject s = parent.createNestedObject(name);
+  s["n"] = stats.count();
+  s["min"] = stats.minCycles();
+  s["max"] = stats.maxCycles();
+  s["mean"] = stats.meanCycles();
+}
+
+void sendRingStats() {
+  LOG_INFO("Ring: %u queued, high-water %u/%u, dropped %lu",
+           (unsigned)sampleRing.size(), (unsigned)sampleRing.highWater(),
+           (unsigned)sampleRing.capacity(), (unsigned long)sampleRing.dropped());
+
+  StaticJsonDocument<768> doc;
+  doc["type"] = "stats";
+  doc["device"] = deviceId;
+  doc["ring_high_water"] = (uint32_t)sampleRing.highWater();
+  doc["ring_capacity"] = (uint32_t)sampleRing.capacity();
+  doc["ring_dropped"] = sampleRing.dropped();
+  doc["reconnects"] = linkReconnects;
+  doc["last_reconnect_ms"] = lastReconnectMs;
+
+  // Per-interval cycle cost of the named hot-path sections
+  JsonObject perf = doc.createNestedObject("perf");
+  addPerfSection(perf, "acquire", perfAcquire);
+  addPerfSection(perf, "encode", perfEncode);
+  addPerfSection(perf, "send", perfSend);
+  addPerfSection(perf, "poll", perfPoll);
+  perf["deadline_misses"] = perfDeadlineMisses;
+  JsonArray hist = perf.createNestedArray("loop_hist");
+  for (uint8_t i = 0; i < LoopHistogram::BUCKETS; i++) {
+    hist.add(perfLoopHist.bucket(i));
+  }
+
+  // Memory headroom: largest block vs free heap shows fragmentation,
+  // minimum-ever free heap and the task stack high-water marks show
+  // how close a multi-hour run has come to the edge
+  JsonObject mem = doc.createNestedObject("mem");
+  mem["free_heap"] = esp_get_free_heap_size();
+  mem["min_free_heap"] = esp_get_minimum_free_heap_size();
+  mem["largest_block"] =
+      (uint32_t)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  mem["loop_stack_hw"] = (uint32_t)uxTaskGetStackHighWaterMark(NULL);
+  if (samplerTaskHandle != NULL) {
+    mem["sampler_stack_hw"] =
+        (uint32_t)uxTaskGetStackHighWaterMark(samplerTaskHandle);
+  }
+#if HEAP_AUDIT
+  mem["audit_hits"] = heapAuditHits;
+#endif
+
+  serializeJson(doc, jsonBuf, sizeof(jsonBuf));
+  wsClient.send(jsonBuf);
+
+  perfAcquire.reset();
+  perfEncode.reset();
+  perfSend.reset();
+  perfPoll.reset();
+  perfLoopHist.reset();
+  perfDeadlineMisses = 0;
+}
+
+// ============================================
+// BLACK-BOX FUNCTIONS
+// ============================================
+
+void sendLogList() {
+  StaticJsonDocument<1024> doc;
+  doc["type"] = "log_list";
+  doc["device"] = deviceId;
+  JsonArray files = doc.createNestedArray("files");
+
+  File root = LittleFS.open("/");
+  File entry = root.openNextFile();
+  while (entry) {
+    const char* name = entry.name();
+    size_t len = strlen(name);
+    if (len > 4 && strcmp(name + len - 4, ".rtl") == 0) {
+      // Channel count sits at byte 4 in both RTL2 and RTL3 headers.
+      // RTL3 records are variable-length varints, so size division
+      // only works for RTL2; RTL3 carries the exact record count at
+      // bytes 12..15 instead.
+      uint8_t header[Blackbox::HEADER_SIZE + 4];
+      size_t got = entry.read(header, sizeof(header));
+      bool isRtl = got >= Blackbox::HEADER_SIZE &&
+                   memcmp(header, "RTL", 3) == 0 &&
+                   (header[3] == '2' || header[3] == '3');
+      bool isRtl3 = isRtl && header[3] == '3';
+      uint8_t channels = isRtl ? header[4] : 1;
+      JsonObject f = files.createNestedObject();
+      f["name"] = name;
+      f["size"] = (uint32_t)entry.size();
+      f["channels"] = channels;
+      f["samples"] =
+          (isRtl3 && got == sizeof(header))
+              ? wire::getU32(header + 12)
+              : (uint32_t)((entry.size() - Blackbox::HEADER_SIZE) /
+                           Blackbox::recordSize(channels));
+    }
+    entry = root.openNextFile();
+  }
+
+  serializeJson(doc, jsonBuf, sizeof(jsonBuf));
+  wsClient.send(jsonBuf);
+}
+
+// Reads one varint from an open log file. Returns false at EOF or on
+// an oversized encoding.
+static bool readLogVarint(File& file, uint32_t& out) {
+  uint32_t v = 0;
+  for (size_t i = 0; i < wire::VARINT_MAX; i++) {
+    int b = file.read();
+    if (b < 0) {
+      return false;
+    }
+    v |= (uint32_t)(b & 0x7F) << (7 * i);
+    if ((b & 0x80) == 0) {
+      out = v;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Reads the next RTL3 record. Keyframe cadence is positional: every
+// KEYFRAME_INTERVAL-th record must open with the marker bytes, which
+// is where a torn write from a mid-test reset gets caught.
+static bool readRtl3Record(File& file, uint8_t channels, uint32_t index,
+                           uint32_t& ts, int32_t* raw) {
+  if (index % Blackbox::KEYFRAME_INTERVAL == 0) {
+    uint8_t mark[2];
+    if (file.read(mark, 2) != 2 || mark[0] != Blackbox::KEYFRAME_MARK0 ||
+        mark[1] != Blackbox::KEYFRAME_MARK1) {
+      return false;
+    }
+    uint8_t abs[4 + 4 * LoadCells::MAX_CHANNELS];
+    size_t absLen = 4 + 4 * (size_t)channels;
+    if (file.read(abs, absLen) != absLen) {
+      return false;
+    }
+    ts = wire::getU32(abs);
+    for (uint8_t ch = 0; ch < channels; ch++) {
+      raw[ch] = (int32_t)wire::getU32(abs + 4 + ch * 4);
+    }
+    return true;
+  }
+
+  uint32_t zz;
+  if (!readLogVarint(file, zz)) {
+    return false;
+  }
+  ts += (uint32_t)wire::unzigzag32(zz);
+  for (uint8_t ch = 0; ch < channels; ch++) {
+    if (!readLogVarint(file, zz)) {
+      return false;
+    }
+    raw[ch] += wire::unzigzag32(zz);
+  }
+  return true;
+}
+
+// Opens a stored log and parses its header, either format: RTL2
+// (fixed records) or RTL3 (delta records, with count and calibration
+// in the extended header). A zero RTL3 count means the log was cut
+// short by a reset - callers stream whatever decodes.
+static bool openLogForRead(const char* name, File& file, bool& deltaLog,
+                           uint8_t& channels, float* scale,
+                           long* offsetCal, uint32_t& total) {
+  char path[40];
+  snprintf(path, sizeof(path), "%s%s", (name[0] == '/') ? "" : "/", name);
+
+  file = LittleFS.open(path, FILE_READ);
+  if (!file) {
+    LOG_ERROR("Log %s not found", path);
+    return false;
+  }
+
+  uint8_t header[Blackbox::HEADER_SIZE];
+  if (file.read(header, sizeof(header)) != sizeof(header) ||
+      memcmp(header, "RTL", 3) != 0 ||
+      (header[3] != '2' && header[3] != '3')) {
+    LOG_ERROR("%s is not a black-box log", path);
+    file.close();
+    return false;
+  }
+  deltaLog = (header[3] == '3');
+  channels = header[4];
+  if (channels == 0 || channels > LoadCells::MAX_CHANNELS) {
+    LOG_ERROR("%s has a bad channel count (%u)", path, channels);
+    file.close();
+    return false;
+  }
+
+  if (deltaLog) {
+    uint8_t ext[4 + 8 * LoadCells::MAX_CHANNELS];
+    size_t extLen = 4 + 8 * (size_t)channels;
+    if (file.read(ext, extLen) != extLen) {
+      LOG_ERROR("%s has a truncated header", path);
+      file.close();
+      return false;
+    }
+    total = wire::getU32(ext);
+    for (uint8_t ch = 0; ch < channels; ch++) {
+      scale[ch] = wire::getFloat(ext + 4 + ch * 8);
+      offsetCal[ch] = (long)(int32_t)wire::getU32(ext + 8 + ch * 8);
+    }
+  } else {
+    total = (file.size() - Blackbox::HEADER_SIZE) / Blackbox::recordSize(channels);
+  }
+  return true;
+}
+
+// Reads and decodes the next sample from an open log. RTL2 records
+// carry force directly; RTL3 recomputes it from the header
+// calibration. ts and raw carry delta-decode state across calls and
+// must start zeroed.
+static bool readLogSample(File& file, bool deltaLog, uint8_t channels,
+                          uint32_t index, uint32_t& ts, int32_t* raw,
+                          float* force, const float* scale,
+                          const long* offsetCal) {
+  if (deltaLog) {
+    if (!readRtl3Record(file, channels, index, ts, raw)) {
+      return false;
+    }
+    for (uint8_t ch = 0; ch < channels; ch++) {
+      force[ch] = ((raw[ch] - offsetCal[ch]) / scale[ch]) / 1000.0 * 9.81;
+    }
+    return true;
+  }
+
+  uint8_t record[Blackbox::recordSize(LoadCells::MAX_CHANNELS)];
+  size_t recordSize = Blackbox::recordSize(channels);
+  if (file.read(record, recordSize) != recordSize) {
+    return false;
+  }
+  memcpy(&ts, record, 4);
+  for (uint8_t ch = 0; ch < channels; ch++) {
+    memcpy(&raw[ch], record + 4 + ch * 8, 4);
+    memcpy(&force[ch], record + 8 + ch * 8, 4);
+  }
+  return true;
+}
+
+void uploadLog(const char* name) {
+  File file;
+  bool deltaLog = false;
+  uint8_t channels = 0;
+  float scale[LoadCells::MAX_CHANNELS];
+  long offsetCal[LoadCells::MAX_CHANNELS];
+  uint32_t total = 0;
+  if (!openLogForRead(name, file, deltaLog, channels, scale, offsetCal,
+                      total)) {
+    return;
+  }
+
+  LOG_INFO("Uploading %s: %lu samples x %u channel(s)", name,
+           (unsigned long)total, channels);
+
+  // Announce the upload so the server routes the following batch
+  // frames into the stored test instead of the live trace
+  {
+    StaticJsonDocument<192> doc;
+    doc["type"] = "log_upload_begin";
+    doc["device"] = deviceId;
+    doc["file"] = name;
+    doc["samples"] = total;
+    doc["channels"] = channels;
+    serializeJson(doc, jsonBuf, sizeof(jsonBuf));
+    wsClient.send(jsonBuf);
+  }
+
+  unsigned long startMs = millis();
+  uint32_t sent = 0;
+  wire::BatchEncoder encoder(uploadBuf, UPLOAD_BATCH_SAMPLES, channels);
+  uint32_t ts = 0;
+  int32_t raw[LoadCells::MAX_CHANNELS] = {0};
+  bool more = true;
+
+  while (more) {
+    encoder.begin(sent);
+    while (!encoder.full()) {
+      float force[LoadCells::MAX_CHANNELS];
+      if (!readLogSample(file, deltaLog, channels, sent + encoder.count(),
+                         ts, raw, force, scale, offsetCal)) {
+        more = false;
+        break;
+      }
+      encoder.add(ts, raw, force);
+    }
+    if (encoder.count() == 0) {
+      break;
+    }
+    size_t len = encoder.finish();
+    wsClient.sendBinary((const char*)uploadBuf, len);
+    sent += encoder.count();
+    // A long upload on a slow link legitimately outlasts the watchdog
+    esp_task_wdt_reset();
+  }
+
+  file.close();
+
+  {
+    StaticJsonDocument<192> doc;
+    doc["type"] = "log_upload_end";
+    doc["device"] = deviceId;
+    doc["file"] = name;
+    doc["samples"] = sent;
+    serializeJson(doc, jsonBuf, sizeof(jsonBuf));
+    wsClient.send(jsonBuf);
+  }
+
+  unsigned long elapsed = millis() - startMs;
+  LOG_INFO("Upload complete: %lu samples in %lu ms", (unsigned long)sent,
+           elapsed);
+}
+
+void startReplay(const char* name) {
+  if (replayActive) {
+    LOG_WARN("Replay already in progress");
+    return;
+  }
+
+  uint32_t total = 0;
+  if (!openLogForRead(name, replayFile, replayDelta, replayChannels,
+                      replayScale, replayOffsetCal, total)) {
+    return;
+  }
+  // Close out any live batch in flight before the announcement, so no
+  // live frame lands after the server switches into replay routing
+  flushBatch();
+
+  snprintf(replayName, sizeof(replayName), "%s", name);
+  replayEof = false;
+  replaySamples = 0;
+  replayFramesSent = 0;
+  replayFramesAcked = 0;
+  replayBytes = 0;
+  replayTs = 0;
+  memset(replayRaw, 0, sizeof(replayRaw));
+  replayStartMs = millis();
+  replayActive = true;
+
+  // Same routing announcement as uploadLog: the batch frames that
+  // follow belong to the stored test, not the live trace
+  StaticJsonDocument<256> doc;
+  doc["type"] = "replay_begin";
+  doc["device"] = deviceId;
+  doc["file"] = replayName;
+  doc["samples"] = total;
+  doc["channels"] = replayChannels;
+  doc["window"] = REPLAY_WINDOW;
+  serializeJson(doc, jsonBuf, sizeof(jsonBuf));
+  wsClient.send(jsonBuf);
+
+  LOG_INFO("Replay of %s started (%lu samples)", replayName,
+           (unsigned long)total);
+}
+
+static void finishReplay(bool aborted) {
+  replayFile.close();
+  replayActive = false;
+
+  unsigned long elapsed = millis() - replayStartMs;
+  uint32_t kbps =
+      (elapsed > 0) ? (uint32_t)((uint64_t)replayBytes * 8 / elapsed) : 0;
+
+  if (!aborted) {
+    StaticJsonDocument<256> doc;
+    doc["type"] = "replay_end";
+    doc["device"] = deviceId;
+    doc["file"] = replayName;
+    doc["samples"] = replaySamples;
+    doc["bytes"] = replayBytes;
+    doc["elapsed_ms"] = (uint32_t)elapsed;
+    doc["kbps"] = kbps;
+    serializeJson(doc, jsonBuf, sizeof(jsonBuf));
+    wsClient.send(jsonBuf);
+  }
+
+  LOG_INFO("Replay %s: %lu samples, %lu bytes in %lu ms (%lu kbit/s)",
+           aborted ? "aborted" : "complete", (unsigned long)replaySamples,
+           (unsigned long)replayBytes, elapsed, (unsigned long)kbps);
+}
+
+void replayStep() {
+  if (!replayActive) {
+    return;
+  }
+  if (!wsClient.available()) {
+    finishReplay(true);
+    return;
+  }
+
+  // Send until the window closes; acks arriving through poll() reopen
+  // it next pass. Worst case per pass is REPLAY_WINDOW frames, so the
+  // ring drain above never waits long behind a transfer.
+  while (replayFramesSent - replayFramesAcked < REPLAY_WINDOW) {
+    wire::BatchEncoder encoder(uploadBuf, UPLOAD_BATCH_SAMPLES,
+                               replayChannels);
+    encoder.begin(replaySamples);
+    while (!encoder.full()) {
+      float force[LoadCells::MAX_CHANNELS];
+      if (!readLogSample(replayFile, replayDelta, replayChannels,
+                         replaySamples + encoder.count(), replayTs,
+                         replayRaw, force, replayScale, replayOffsetCal)) {
+        replayEof = true;
+        break;
+      }
+      encoder.add(replayTs, replayRaw, force);
+    }
+    if (encoder.count() > 0) {
+      size_t len = encoder.finish();
+      wsClient.sendBinary((const char*)uploadBuf, len);
+      replayBytes += (uint32_t)len;
+      replaySamples += encoder.count();
+      replayFramesSent++;
+    }
+    if (replayEof) {
+      finishReplay(false);
+      return;
+    }
+  }
+}
+
+void deleteLog(const char* name) {
+  char path[40];
+  snprintf(path, sizeof(path), "%s%s", (name[0] == '/') ? "" : "/", name);
+
+  if (LittleFS.remove(path)) {
+    LOG_INFO("Deleted log %s", path);
+  } else {
+    LOG_ERROR("Could not delete %s", path);
+  }
+}
+
+// Scans an unclean RTL3 log (header count still zero - the reset hit
+// mid-test), counts the records that decode, and patches the count
+// into the header so the file uploads like any cleanly closed log.
+// Returns the recovered sample count.
+static uint32_t finalizeUncleanLog(const char* name) {
+  File file;
+  bool deltaLog = false;
+  uint8_t channels = 0;
+  float scale[LoadCells::MAX_CHANNELS];
+  long offsetCal[LoadCells::MAX_CHANNELS];
+  uint32_t total = 0;
+  if (!openLogForRead(name, file, deltaLog, channels, scale, offsetCal,
+                      total) ||
+      !deltaLog) {
+    if (file) {
+      file.close();
+    }
+    return 0;
+  }
+
+  uint32_t count = 0;
+  uint32_t ts = 0;
+  int32_t raw[LoadCells::MAX_CHANNELS] = {0};
+  while (readRtl3Record(file, channels, count, ts, raw)) {
+    count++;
+  }
+  file.close();
+
+  if (count > 0) {
+    char path[40];
+    snprintf(path, sizeof(path), "%s%s", (name[0] == '/') ? "" : "/", name);
+    File patch = LittleFS.open(path, "r+");
+    if (patch && patch.seek(Blackbox::HEADER_SIZE)) {
+      uint8_t buf[4];
+      wire::putU32(buf, count);
+      patch.write(buf, sizeof(buf));
+    }
+    if (patch) {
+      patch.close();
+    }
+  }
+  return count;
+}
+
+void recoverCrashedLog(bool resume) {
+  // An RTL3 log whose count was never patched in marks a test that a
+  // reset cut short. Finalize it whatever this boot is; if this boot
+  // itself is the crash recovery, also pick the test back up - the
+  // motor may still be burning.
+  bool foundUnclean = false;
+
+  File root = LittleFS.open("/");
+  File entry = root ? root.openNextFile() : File();
+  while (entry) {
+    char name[32];
+    snprintf(name, sizeof(name), "%s", entry.name());
+    uint8_t header[Blackbox::HEADER_SIZE + 4];
+    bool unclean = (!entry.isDirectory() &&
+                    entry.read(header, sizeof(header)) == sizeof(header) &&
+                    memcmp(header, "RTL3", 4) == 0 &&
+                    wire::getU32(header + Blackbox::HEADER_SIZE) == 0 &&
+                    entry.size() >= Blackbox::headerSize(header[4]));
+    entry.close();
+    if (unclean) {
+      uint32_t count = finalizeUncleanLog(name);
+      if (count > 0) {
+        LOG_WARN("Recovered unclean log %s: %lu samples", name,
+                 (unsigned long)count);
+      } else {
+        // Header-only: the reset hit before the first chunk of
+        // records reached flash. Nothing to salvage - drop the file
+        // so it is not re-detected as unclean on every boot.
+        LOG_WARN("Unclean log %s had no recoverable samples - deleted",
+                 name);
+        deleteLog(name);
+      }
+      foundUnclean = true;
+    }
+    entry = root.openNextFile();
+  }
+  if (root) {
+    root.close();
+  }
+
+  if (resume && foundUnclean) {
+    LOG_WARN("Reset interrupted a test - resuming recording");
+    setSampleRate(true);
+    liveStats.reset();
+    blackbox.startLog((uint32_t)esp_timer_get_time(), HX711_CHANNEL_COUNT,
+                      calibration_scale, calibration_offset);
+    currentState = TESTING;
+  }
+}
+
+void flushPretrigger() {
+  if (pretrigCount == 0) {
+    return;
+  }
+  LOG_INFO("Prepending %u pre-trigger samples", (unsigned)pretrigCount);
+
+  // Oldest first: with the ring full, the head slot is also the tail
+  size_t idx = (pretrigCount == PRETRIGGER_CAPACITY)
+                   ? pretrigHead
+                   : (pretrigHead + PRETRIGGER_CAPACITY - pretrigCount) %
+                         PRETRIGGER_CAPACITY;
+
+  wire::BatchEncoder encoder(uploadBuf, UPLOAD_BATCH_SAMPLES,
+                             HX711_CHANNEL_COUNT);
+  size_t remaining = pretrigCount;
+  while (remaining > 0) {
+    if (wireFormat == WIRE_BINARY) {
+      encoder.begin(sampleSeq);
+      while (remaining > 0 && !encoder.full()) {
+        const Sample& s = pretrigBuf[idx];
+        blackbox.log(s.timestamp_us, s.raw);
+        encoder.add(s.timestamp_us, s.raw, s.force_n);
+        rememberSent(sampleSeq, s);
+        sampleSeq++;
+        idx = (idx + 1) % PRETRIGGER_CAPACITY;
+        remaining--;
+      }
+      if (encoder.count() > 0) {
+        size_t len = encoder.finish();
+        sendStreamFrame(uploadBuf, len);
+      }
+    } else {
+      // JSON mode: one reading per sample via the live path, so the
+      // sequence numbers handed out here actually reach the server
+      // (sendSample() advances sampleSeq and fills the resend ring).
+      const Sample& s = pretrigBuf[idx];
+      blackbox.log(s.timestamp_us, s.raw);
+      sendSample(s);
+      idx = (idx + 1) % PRETRIGGER_CAPACITY;
+      remaining--;
+    }
+  }
+
+  pretrigHead = 0;
+  pretrigCount = 0;
+
+  // The pre-trigger history is the part of a test that can never be
+  // re-acquired; make it durable before the burn proper starts.
+  blackbox.sync();
+}
+
+void flushBatch() {
+  if (!batchOpen) {
+    return;
+  }
+  ALLOC_GUARD_BEGIN();
+  if (streamDelta) {
+    if (deltaEncoder.count() > 0) {
+      size_t len = deltaEncoder.finish();
+      sendStreamFrame(deltaBuf, len);
+    }
+  } else if (batchEncoder.count() > 0) {
+    size_t len = batchEncoder.finish();
+    sendStreamFrame(batchBuf, len);
+  }
+  batchOpen = false;
+  ALLOC_GUARD_END("binary batch");
+}
+
+void resendRange(uint32_t from, uint32_t count) {
+  if (wireFormat != WIRE_BINARY) {
+    LOG_WARN("Resend requested in JSON mode; ignored");
+    return;
+  }
+  if (count > RESEND_CAPACITY) {
+    count = RESEND_CAPACITY;
+  }
+
+  // Replay contiguous runs still present in the ring as batch frames.
+  // Anything already overwritten is gone from RAM (the black-box log
+  // still has it if a test was running) and gets counted as missed.
+  uint32_t found = 0;
+  wire::BatchEncoder encoder(uploadBuf, UPLOAD_BATCH_SAMPLES,
+                             HX711_CHANNEL_COUNT);
+  bool open = false;
+
+  for (uint32_t seq = from; seq < from + count; seq++) {
+    const SentSample& slot = resendBuf[seq % RESEND_CAPACITY];
+    if (!slot.valid || slot.seq != seq) {
+      if (open) {
+        size_t len = encoder.finish();
+        wsClient.sendBinary((const char*)uploadBuf, len);
+        open = false;
+      }
+      continue;
+    }
+    if (!open) {
+      encoder.begin(seq);
+      open = true;
+    }
+    encoder.add(slot.sample.timestamp_us, slot.sample.raw,
+                slot.sample.force_n);
+    found++;
+    if (encoder.full()) {
+      size_t len = encoder.finish();
+      wsClient.sendBinary((const char*)uploadBuf, len);
+      open = false;
+    }
+  }
+  if (open) {
+    size_t len = encoder.finish();
+    wsClient.sendBinary((const char*)uploadBuf, len);
+  }
+
+  LOG_INFO("Resent %lu of %lu samples from seq %lu", (unsigned long)found,
+           (unsigned long)count, (unsigned long)from);
+}
+
+void sendStreamFrame(const uint8_t* buf, size_t len) {
+  // Live sample frames take the negotiated stream transport; commands
+  // and uploads always use the WebSocket. A batch frame fits one
+  // datagram, so a loss costs that batch and nothing behind it.
+  PERF_BEGIN();
+  if (udpTransport) {
+    udp.beginPacket(IPAddress(netCache.serverIp), udpPort);
+    udp.write(buf, len);
+    udp.endPacket();
+  } else {
+    wsClient.sendBinary((const char*)buf, len);
+  }
+  PERF_END(perfSend);
+}
+
+// ============================================
+// CALIBRATION FUNCTIONS
+// ============================================
+
+void handleStartTest() {
+  if (calOp != CAL_NONE) {
+    // A test takes priority over an in-progress tare/calibration - the
+    // averaging window would be polluted by thrust anyway. Abort it
+    // here; once currentState leaves CALIBRATING the drain loop stops
+    // feeding samples, so a latched calOp would block tare/calibrate
+    // until a reboot.
+    LOG_WARN("Aborting in-progress calibration: test starting");
+    StaticJsonDocument<128> doc;
+    doc["type"] = "calibration_aborted";
+    doc["device"] = deviceId;
+    doc["op"] = (calOp == CAL_TARE) ? "tare" : "calibrate";
+    serializeJson(doc, jsonBuf, sizeof(jsonBuf));
+    wsClient.send(jsonBuf);
+    calOp = CAL_NONE;
+  }
+  LOG_INFO("Starting test recording...");
+  flushBatch();  // Drain idle-batched samples before low-latency mode
+  setSampleRate(true);  // full rate before any data matters
+  liveStats.reset();
+  blackbox.startLog((uint32_t)esp_timer_get_time(), HX711_CHANNEL_COUNT,
+                    calibration_scale, calibration_offset);
+  flushPretrigger();
+  currentState = TESTING;
+}
+
+void handleStopTest() {
+  if (currentState == CALIBRATING) {
+    // There is no test to stop, and dropping to IDLE here would
+    // strand calOp the same way start_test used to - the drain loop
+    // only feeds calibration samples while CALIBRATING. Let the
+    // averaging finish.
+    LOG_WARN("Ignoring stop_test: calibration in progress");
+    return;
+  }
+  LOG_INFO("Stopping test recording");
+  currentState = IDLE;
+  blackbox.stopLog();
+  sendLiveStats();  // final totals for the dashboard
+  setSampleRate(false);
+}
+
+void handleTare() {
+  if (calOp != CAL_NONE || currentState == TESTING) {
+    LOG_WARN("Cannot tare now (busy)");
+    return;
+  }
+  LOG_INFO("Taring load cells (%u samples, async)...", TARE_SAMPLES);
+  startCalibration(CAL_TARE, 0, 0.0f, TARE_SAMPLES);
+}
+
+void handleCalibrate(float known_mass_g, uint8_t channel) {
+  if (channel >= HX711_CHANNEL_COUNT) {
+    LOG_ERROR("No such channel: %u", channel);
+    return;
+  }
+  if (known_mass_g <= 0) {
+    LOG_ERROR("Known mass must be > 0");
+    return;
+  }
+  if (calOp != CAL_NONE || currentState == TESTING) {
+    LOG_WARN("Cannot calibrate now (busy)");
+    return;
+  }
+  LOG_INFO("Calibrating channel %u with known mass %.1fg (%u samples, async)",
+           channel, known_mass_g, CALIBRATE_SAMPLES);
+  startCalibration(CAL_SCALE, channel, known_mass_g, CALIBRATE_SAMPLES);
+}
+
+void startCalibration(CalOp op, uint8_t channel, float known_mass_g,
+                      uint16_t samples) {
+  calOp = op;
+  calChannel = channel;
+  calKnownMass = known_mass_g;
+  calTarget = samples;
+  calCollected = 0;
+  calSettle = CAL_SETTLE_SAMPLES;  // replaces the old blocking delay(500)
+  memset(calSum, 0, sizeof(calSum));
+  currentState = CALIBRATING;
+  setSampleRate(true);  // more conversions per averaging window
+}
+
+void feedCalibration(const Sample& sample) {
+  if (calSettle > 0) {
+    calSettle--;
+    return;
+  }
+  for (uint8_t ch = 0; ch < HX711_CHANNEL_COUNT; ch++) {
+    calSum[ch] += sample.raw[ch];
+  }
+  if (++calCollected >= calTarget) {
+    finishCalibration();
+  }
+}
+
+void finishCalibration() {
+  int32_t avg[HX711_CHANNEL_COUNT];
+  for (uint8_t ch = 0; ch < HX711_CHANNEL_COUNT; ch++) {
+    avg[ch] = (int32_t)(calSum[ch] / calTarget);
+  }
+
+  StaticJsonDocument<192> doc;
+  doc["type"] = "calibration_complete";
+  doc["device"] = deviceId;
+  doc["samples"] = calCollected;
+
+  if (calOp == CAL_TARE) {
+    doc["op"] = "tare";
+    for (uint8_t ch = 0; ch < HX711_CHANNEL_COUNT; ch++) {
+      calibration_offset[ch] = avg[ch];
+      LOG_INFO("Channel %u offset: %ld", ch, (long)calibration_offset[ch]);
+    }
+    doc["offset"] = (int32_t)calibration_offset[0];
+  } else {
+    doc["op"] = "calibrate";
+    doc["channel"] = calChannel;
+    calibration_scale[calChannel] =
+        (avg[calChannel] - calibration_offset[calChannel]) / calKnownMass;
+    doc["scale"] = calibration_scale[calChannel];
+    LOG_INFO("Channel %u scale factor: %.6f", calChannel,
+             calibration_scale[calChannel]);
+
+    // Verification from the same window: what mass would we report?
+    float measured = (avg[calChannel] - calibration_offset[calChannel]) /
+                     calibration_scale[calChannel];
+    LOG_INFO("Verification - Measured mass: %.2fg", measured);
+  }
+
+  saveCalibration();
+
+  serializeJson(doc, jsonBuf, sizeof(jsonBuf));
+  wsClient.send(jsonBuf);
+
+  calOp = CAL_NONE;
+  currentState = IDLE;
+  setSampleRate(false);
+  LOG_INFO("Calibration complete");
+}
+
+// Channel 0 keeps the original "scale"/"offset" NVS keys so existing
+// calibrations survive the multi-channel upgrade; channel N >= 1 uses
+// "scaleN"/"offsetN".
+static void calibrationKeys(uint8_t ch, char* scaleKey, char* offsetKey) {
+  if (ch == 0) {
+    strcpy(scaleKey, "scale");
+    strcpy(offsetKey, "offset");
+  } else {
+    sprintf(scaleKey, "scale%u", ch);
+    sprintf(offsetKey, "offset%u", ch);
+  }
+}
+
+void loadCalibration() {
+  LOG_INFO("Loading calibration from NVS...");
+
+  prefs.begin("test-stand", false);
+
+  for (uint8_t ch = 0; ch < HX711_CHANNEL_COUNT; ch++) {
+    char scaleKey[12], offsetKey[12];
+    calibrationKeys(ch, scaleKey, offsetKey);
+    calibration_scale[ch] = prefs.getFloat(scaleKey, 1.0);
+    calibration_offset[ch] = prefs.getLong(offsetKey, 0);
+    LOG_INFO("Channel %u scale: %.6f, offset: %ld", ch,
+             calibration_scale[ch], (long)calibration_offset[ch]);
+  }
+
+  prefs.end();
+}
+
+void saveCalibration() {
+  // Already live in RAM; the NVS commit happens from persistStep()
+  persistPending |= PERSIST_CALIBRATION;
+}
+
+void writeCalibrationNvs() {
+  LOG_INFO("Saving calibration to NVS...");
+
+  prefs.begin("test-stand", false);
+
+  for (uint8_t ch = 0; ch < HX711_CHANNEL_COUNT; ch++) {
+    char scaleKey[12], offsetKey[12];
+    calibrationKeys(ch, scaleKey, offsetKey);
+    prefs.putFloat(scaleKey, calibration_scale[ch]);
+    prefs.putLong(offsetKey, calibration_offset[ch]);
+  }
+
+  prefs.end();
+
+  LOG_INFO("Calibration saved");
+}
+
+void loadDeviceId() {
+  prefs.begin("test-stand", false);
+  size_t len = prefs.getString("device_id", deviceId, sizeof(deviceId));
+  prefs.end();
+
+  if (len == 0) {
+    // First boot on this part: the STA MAC is unique per module, which
+    // is all a default needs to be
+    uint8_t mac[6];
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    snprintf(deviceId, sizeof(deviceId), "stand-%02x%02x%02x", mac[3],
+             mac[4], mac[5]);
+  }
+  LOG_INFO("Device ID: %s", deviceId);
+}
+
+void writeDeviceIdNvs() {
+  prefs.begin("test-stand", false);
+  prefs.putString("device_id", deviceId);
+  prefs.end();
+
+  LOG_INFO("Device ID saved");
+}
+
+void loadNetCache() {
+  prefs.begin("test-stand", false);
+
+  netCache.valid = prefs.getBool("net_valid", false);
+  if (netCache.valid) {
+    prefs.getBytes("net_bssid", netCache.bssid, sizeof(netCache.bssid));
+    netCache.channel = prefs.getUChar("net_chan", 0);
+    netCache.ip = prefs.getULong("net_ip", 0);
+    netCache.gateway = prefs.getULong("net_gw", 0);
+    netCache.netmask = prefs.getULong("net_mask", 0);
+    netCache.dns = prefs.getULong("net_dns", 0);
+    netCache.serverIp = prefs.getULong("net_srv", 0);
+    LOG_INFO("WiFi fast-connect cache loaded (ch %u)", netCache.channel);
+  }
+
+  prefs.end();
+}
+
+void saveNetCache() {
+  NetCache fresh = {};  // zeroed so padding doesn't defeat the memcmp
+  fresh.valid = true;
+  memcpy(fresh.bssid, WiFi.BSSID(), sizeof(fresh.bssid));
+  fresh.channel = (uint8_t)WiFi.channel();
+  fresh.ip = (uint32_t)WiFi.localIP();
+  fresh.gateway = (uint32_t)WiFi.gatewayIP();
+  fresh.netmask = (uint32_t)WiFi.subnetMask();
+  fresh.dns = (uint32_t)WiFi.dnsIP();
+  fresh.serverIp = netCache.serverIp;
+
+  // NVS commits are not free; skip the write when nothing moved
+  if (netCache.valid && memcmp(&fresh, &netCache, sizeof(fresh)) == 0) {
+    return;
+  }
+  netCache = fresh;  // fast-connect works from RAM right away
+  persistPending |= PERSIST_NET_CACHE;
+}
+
+void writeNetCacheNvs() {
+  prefs.begin("test-stand", false);
+  prefs.putBool("net_valid", true);
+  prefs.putBytes("net_bssid", netCache.bssid, sizeof(netCache.bssid));
+  prefs.putUChar("net_chan", netCache.channel);
+  prefs.putULong("net_ip", netCache.ip);
+  prefs.putULong("net_gw", netCache.gateway);
+  prefs.putULong("net_mask", netCache.netmask);
+  prefs.putULong("net_dns", netCache.dns);
+  prefs.putULong("net_srv", netCache.serverIp);
+  prefs.end();
+
+  LOG_INFO("WiFi fast-connect cache saved (ch %u)", netCache.channel);
+}
+
+void persistStep() {
+  if (persistPending == 0 || currentState != IDLE || !sampleRing.empty()) {
+    return;
+  }
+
+  // One group per pass keeps any single flash stall bounded
+  if (persistPending & PERSIST_CALIBRATION) {
+    persistPending &= ~PERSIST_CALIBRATION;
+    writeCalibrationNvs();
+  } else if (persistPending & PERSIST_NET_CACHE) {
+    persistPending &= ~PERSIST_NET_CACHE;
+    writeNetCacheNvs();
+  } else if (persistPending & PERSIST_DEVICE_ID) {
+    persistPending &= ~PERSIST_DEVICE_ID;
+    writeDeviceIdNvs();
+  }
+}
 
-  Serial.print("Loop count: ");
-  Serial.println(count++);
+// ============================================
+// UTILITY FUNCTIONS
+// ============================================
 
-  delay(1000);
+void setStatusLED(bool on) {
+  #if USE_STATUS_LED
+    digitalWrite(STATUS_LED_PIN, on ? HIGH : LOW);
+  #endif
 }
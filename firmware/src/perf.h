@@ -0,0 +1,88 @@
+/**
+ * Cycle-count accumulators for hot-path instrumentation.
+ *
+ * The RISC-V mcycle CSR gives a free, always-on clock with single-cycle
+ * resolution; main.cpp brackets named sections of the loop (acquire,
+ * encode, send, poll) with it and feeds the deltas in here. Everything
+ * is O(1) per sample - a handful of compares and adds - so the
+ * instrumentation itself does not distort what it measures. The
+ * accumulated numbers ride the periodic stats frame and are reset with
+ * each report, so every figure is per-interval, not since-boot.
+ *
+ * Like wire_format.h, free of Arduino dependencies so the accumulators
+ * can be compiled and exercised on the host.
+ */
+
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+
+/** Min/max/mean cycle cost of one named section. */
+class CycleStats {
+ public:
+  void add(uint32_t cycles) {
+    if (count_ == 0 || cycles < min_) {
+      min_ = cycles;
+    }
+    if (cycles > max_) {
+      max_ = cycles;
+    }
+    sum_ += cycles;
+    count_++;
+  }
+
+  void reset() {
+    sum_ = 0;
+    count_ = 0;
+    min_ = 0;
+    max_ = 0;
+  }
+
+  uint32_t count() const { return count_; }
+  uint32_t minCycles() const { return min_; }
+  uint32_t maxCycles() const { return max_; }
+  uint32_t meanCycles() const {
+    return count_ ? (uint32_t)(sum_ / count_) : 0;
+  }
+
+ private:
+  uint64_t sum_ = 0;
+  uint32_t count_ = 0;
+  uint32_t min_ = 0;
+  uint32_t max_ = 0;
+};
+
+/**
+ * Power-of-two histogram of loop iteration cost. Bucket i counts
+ * iterations costing [2^(FIRST_SHIFT+i), 2^(FIRST_SHIFT+i+1)) cycles;
+ * the first and last buckets also absorb everything below and above.
+ * At 160 MHz the default buckets start at ~6 us and top out past 5 ms,
+ * which spans an empty pass through loop() up to a flash write stall.
+ */
+class LoopHistogram {
+ public:
+  static const uint8_t BUCKETS = 8;
+  static const uint8_t FIRST_SHIFT = 10;
+
+  void add(uint32_t cycles) {
+    uint8_t b = 0;
+    while (b + 1 < BUCKETS && (cycles >> (FIRST_SHIFT + b + 1)) != 0) {
+      b++;
+    }
+    counts_[b]++;
+  }
+
+  void reset() {
+    for (uint8_t i = 0; i < BUCKETS; i++) {
+      counts_[i] = 0;
+    }
+  }
+
+  uint32_t bucket(uint8_t i) const { return counts_[i]; }
+
+ private:
+  uint32_t counts_[BUCKETS] = {0};
+};
+
+#endif  // PERF_H
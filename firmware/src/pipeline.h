@@ -0,0 +1,169 @@
+/**
+ * Compile-time composable acquisition pipeline.
+ *
+ * The shipping firmware picks its filter, encoding, and framing at
+ * runtime because they are negotiated per connection (set_filter,
+ * set_format) - which puts a mode branch in the per-sample path for
+ * every choice. On a 160 MHz single-issue C3 those branches add up,
+ * and a fixed-function deployment that never renegotiates pays for
+ * flexibility it does not use.
+ *
+ * The stages here compose as templates instead:
+ *
+ *   Pipeline<Filter, Encoder, Sink, CHANNELS, DECIMATE>
+ *
+ * so a given instantiation contains no dispatch at all - the compiler
+ * flattens push() into straight-line code for exactly the configured
+ * path. Filter policies are the kernels from filter.h (MedianFilter,
+ * FixedBiquad - already branch-free; FilterStage's runtime mode
+ * switch is precisely what a specialization avoids), plus PassFilter
+ * as the explicit do-nothing. Encoder policies wrap the wire_format.h
+ * encoders behind one add(timestamp, raw[], force[]) shape. The Sink
+ * receives finished frames; a firmware sink hands them to the socket,
+ * the bench sink just counts bytes.
+ *
+ * A fixed-function build instantiates its pipeline once and feeds it
+ * from the ring drain; the negotiated firmware keeps its runtime
+ * branches. The native bench builds the common specializations next
+ * to the runtime-branching path so the per-configuration win is a
+ * measured number (see bench_main.cpp).
+ *
+ * Like wire_format.h and filter.h, free of Arduino dependencies.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "filter.h"
+#include "wire_format.h"
+
+namespace pipeline {
+
+/** Do-nothing filter policy; apply() inlines to a register move. */
+struct PassFilter {
+  int32_t apply(int32_t raw) { return raw; }
+};
+
+/** Plain batch frames (FRAME_BATCH / FRAME_BATCH_MC). */
+template <uint8_t CHANNELS>
+class BatchPolicy {
+ public:
+  BatchPolicy(uint8_t* buf, size_t samplesPerFrame)
+      : enc_(buf, samplesPerFrame, CHANNELS), buf_(buf) {}
+
+  void begin(uint32_t seq, const float*, const long*) { enc_.begin(seq); }
+  void add(uint32_t timestamp_us, const int32_t* raw, const float* force) {
+    enc_.add(timestamp_us, raw, force);
+  }
+  bool full() const { return enc_.full(); }
+  size_t count() const { return enc_.count(); }
+  size_t finish() { return enc_.finish(); }
+  const uint8_t* data() const { return buf_; }
+
+ private:
+  wire::BatchEncoder enc_;
+  uint8_t* buf_;
+};
+
+/** Delta-varint batch frames (FRAME_BATCH_D); force is dropped and
+ *  rebuilt server-side from the in-band calibration. */
+template <uint8_t CHANNELS>
+class DeltaPolicy {
+ public:
+  DeltaPolicy(uint8_t* buf, size_t samplesPerFrame)
+      : enc_(buf, samplesPerFrame, CHANNELS), buf_(buf) {}
+
+  void begin(uint32_t seq, const float* scale, const long* offset) {
+    enc_.begin(seq, scale, offset);
+  }
+  void add(uint32_t timestamp_us, const int32_t* raw, const float*) {
+    enc_.add(timestamp_us, raw);
+  }
+  bool full() const { return enc_.full(); }
+  size_t count() const { return enc_.count(); }
+  size_t finish() { return enc_.finish(); }
+  const uint8_t* data() const { return buf_; }
+
+ private:
+  wire::DeltaBatchEncoder enc_;
+  uint8_t* buf_;
+};
+
+/**
+ * The per-sample path: filter each channel, decimate, convert counts
+ * to newtons with the stand calibration, encode, and hand finished
+ * frames to the sink. Every stage is a template parameter, so each
+ * instantiation is a dedicated straight-line function.
+ */
+template <typename Filter, typename Encoder, typename Sink,
+          uint8_t CHANNELS = 1, uint8_t DECIMATE = 1>
+class Pipeline {
+ public:
+  Pipeline(Encoder& encoder, Sink& sink, const float* scale,
+           const long* offset)
+      : encoder_(encoder), sink_(sink), scale_(scale), offset_(offset) {}
+
+  /** Per-channel filter access, for configure-time setup only. */
+  Filter& filter(uint8_t ch) { return filters_[ch]; }
+
+  void push(uint32_t timestamp_us, const int32_t* raw) {
+    int32_t filtered[CHANNELS];
+    for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+      filtered[ch] = filters_[ch].apply(raw[ch]);
+    }
+
+    if (DECIMATE > 1) {  // compile-time constant: dead code at 1
+      if (++phase_ < DECIMATE) {
+        return;
+      }
+      phase_ = 0;
+    }
+
+    float force[CHANNELS];
+    for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+      force[ch] =
+          ((filtered[ch] - offset_[ch]) / scale_[ch]) / 1000.0f * 9.81f;
+    }
+
+    if (!open_) {
+      encoder_.begin(seq_, scale_, offset_);
+      open_ = true;
+    }
+    encoder_.add(timestamp_us, filtered, force);
+    seq_++;
+    if (encoder_.full()) {
+      flush();
+    }
+  }
+
+  /** Close the open frame, if any, and pass it to the sink. */
+  void flush() {
+    if (!open_) {
+      return;
+    }
+    if (encoder_.count() > 0) {
+      size_t len = encoder_.finish();
+      sink_.onFrame(encoder_.data(), len);
+    }
+    open_ = false;
+  }
+
+  uint32_t samplesOut() const { return seq_; }
+
+ private:
+  Filter filters_[CHANNELS];
+  Encoder& encoder_;
+  Sink& sink_;
+  const float* scale_;
+  const long* offset_;
+  uint32_t seq_ = 0;
+  uint8_t phase_ = 0;
+  bool open_ = false;
+};
+
+}  // namespace pipeline
+
+#endif  // PIPELINE_H
@@ -0,0 +1,93 @@
+/**
+ * Lock-free single-producer/single-consumer ring buffer.
+ *
+ * Decouples the acquisition side from the network side: the sampler
+ * pushes at 80 Hz and must never block, while the consumer drains at
+ * whatever rate the link sustains. One writer and one reader only -
+ * the indices are only ever advanced by their owning side, so a pair
+ * of acquire/release atomics is all the synchronization needed.
+ *
+ * push() on a full ring drops the sample and counts it rather than
+ * overwriting or blocking; the high-water mark records how close the
+ * ring has come to overflow so headroom is observable in the field.
+ *
+ * Header-only and free of Arduino/FreeRTOS dependencies so it can be
+ * exercised on the host.
+ */
+
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+template <typename T, size_t CAPACITY>
+class SpscRing {
+ public:
+  SpscRing() : head_(0), tail_(0), highWater_(0), dropped_(0) {}
+
+  /** Producer side. Returns false (and counts a drop) if full. */
+  bool push(const T& item) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t next = increment(head);
+    if (next == tail_.load(std::memory_order_acquire)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    buf_[head] = item;
+    head_.store(next, std::memory_order_release);
+
+    size_t used = size();
+    if (used > highWater_.load(std::memory_order_relaxed)) {
+      highWater_.store(used, std::memory_order_relaxed);
+    }
+    return true;
+  }
+
+  /** Consumer side. Returns false if empty. */
+  bool pop(T& item) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = buf_[tail];
+    tail_.store(increment(tail), std::memory_order_release);
+    return true;
+  }
+
+  /** Entries currently queued (approximate under concurrency). */
+  size_t size() const {
+    size_t head = head_.load(std::memory_order_acquire);
+    size_t tail = tail_.load(std::memory_order_acquire);
+    return (head >= tail) ? (head - tail) : (CAPACITY + 1 - (tail - head));
+  }
+
+  bool empty() const { return size() == 0; }
+
+  size_t capacity() const { return CAPACITY; }
+
+  /** Most entries ever queued at once. */
+  size_t highWater() const {
+    return highWater_.load(std::memory_order_relaxed);
+  }
+
+  /** Samples rejected because the ring was full. */
+  uint32_t dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  // One slot is kept empty to distinguish full from empty.
+  size_t increment(size_t idx) const {
+    return (idx + 1) % (CAPACITY + 1);
+  }
+
+  T buf_[CAPACITY + 1];
+  std::atomic<size_t> head_;  // next write slot, owned by producer
+  std::atomic<size_t> tail_;  // next read slot, owned by consumer
+  std::atomic<size_t> highWater_;
+  std::atomic<uint32_t> dropped_;
+};
+
+#endif  // RING_BUFFER_H
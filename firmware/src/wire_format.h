@@ -0,0 +1,423 @@
+/**
+ * Binary wire format for sensor readings.
+ *
+ * Replaces the per-sample JSON payload with a packed little-endian frame.
+ * A JSON reading is ~80 bytes of text plus serialization cost; a binary
+ * reading frame is 22 bytes built straight into a caller-provided buffer,
+ * so the hot path does no heap allocation at all.
+ *
+ * The format is negotiated at WebSocket connect time: the device sends a
+ * JSON "hello" listing the formats it supports, and the server answers
+ * with "set_format". Until (or unless) the server opts in, the device
+ * keeps sending JSON, so old servers continue to work unchanged.
+ *
+ * Reading frame v2 (little-endian):
+ *
+ *   offset  size  field
+ *   0       2     magic "RT" (0x52 0x54)
+ *   2       1     format version (2)
+ *   3       1     frame type (0x01 = reading)
+ *   4       4     sequence number (monotonic, per boot)
+ *   8       4     timestamp, us since boot (low 32 bits of the 64-bit
+ *                 esp_timer clock; wraps every ~71 min, the server
+ *                 unwraps using monotonicity)
+ *   12      4     raw ADC value (24-bit HX711 word, sign-extended)
+ *   16      4     force in newtons (IEEE-754 float)
+ *   20      2     CRC-16/CCITT-FALSE over bytes 0..19
+ *
+ * v1 carried millisecond timestamps; v2 switched to microseconds so
+ * thrust data can be aligned against high-speed camera footage with
+ * sub-millisecond error (see the time_sync exchange in main.cpp).
+ *
+ * This header is deliberately free of Arduino dependencies so the
+ * encoder can be compiled and exercised on the host.
+ */
+
+#ifndef WIRE_FORMAT_H
+#define WIRE_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+namespace wire {
+
+constexpr uint8_t MAGIC0 = 'R';
+constexpr uint8_t MAGIC1 = 'T';
+constexpr uint8_t VERSION = 2;
+
+// Frame types
+constexpr uint8_t FRAME_READING = 0x01;
+constexpr uint8_t FRAME_BATCH = 0x02;
+constexpr uint8_t FRAME_BATCH_MC = 0x03;  // multi-channel batch
+constexpr uint8_t FRAME_BATCH_D = 0x04;   // delta-compressed batch
+constexpr uint8_t FRAME_COMMAND = 0x10;   // server -> device command
+
+constexpr size_t HEADER_SIZE = 4;             // magic + version + type
+constexpr size_t READING_FRAME_SIZE = 22;
+
+// Batch frame v1: header, first sequence number (u32), sample count
+// (u16), then count x 12-byte samples (timestamp u32, raw i32, force
+// f32), then CRC-16 over everything before it. Samples in a batch have
+// consecutive sequence numbers starting at the first.
+constexpr size_t BATCH_SAMPLE_SIZE = 12;
+constexpr size_t BATCH_HEADER_SIZE = HEADER_SIZE + 4 + 2;
+
+// Multi-channel batch frame (type 0x03): as a batch frame, plus a
+// channel-count byte after the sample count; each sample is the
+// timestamp (u32) followed by one (raw i32, force f32) pair per
+// channel. Single-channel builds keep emitting type 0x02 so nothing
+// changes on the wire for the common one-load-cell stand.
+constexpr size_t batchSampleSize(size_t channels) {
+  return 4 + channels * 8;
+}
+
+constexpr size_t batchHeaderSize(size_t channels) {
+  return BATCH_HEADER_SIZE + ((channels > 1) ? 1 : 0);
+}
+
+constexpr size_t batchFrameSize(size_t count, size_t channels) {
+  return batchHeaderSize(channels) + count * batchSampleSize(channels) + 2;
+}
+
+constexpr size_t batchFrameSize(size_t count) {
+  return batchFrameSize(count, 1);
+}
+
+// Delta-compressed batch frame (type 0x04). Consecutive HX711 counts
+// differ by small values at rest and during smooth burns, so raw
+// values are sent as zigzag varints of the sample-to-sample delta
+// instead of fixed 8 bytes of raw + force per channel. Force is not
+// carried at all: the frame header includes the calibration (scale,
+// offset) per channel, so the decoder recomputes it exactly as
+// countsToNewtons() does. Every frame opens with an absolute sample,
+// so each frame is its own keyframe and a lost datagram costs nothing
+// downstream.
+//
+//   offset        size   field
+//   0             4      magic, version, type (0x04)
+//   4             4      first sequence number (u32)
+//   8             2      sample count (u16)
+//   10            1      channel count (u8)
+//   11            2      payload length in bytes (u16)
+//   13            8*ch   per channel: scale (f32), offset (i32)
+//   13+8*ch       var    payload (see below)
+//   ...           2      CRC-16 over everything before it
+//
+// Payload: first sample absolute - timestamp (u32), raw (i32) per
+// channel - then per sample: varint(zigzag(dt_us)), then
+// varint(zigzag(draw)) per channel.
+constexpr size_t DELTA_HEADER_SIZE = HEADER_SIZE + 4 + 2 + 1 + 2;
+constexpr size_t VARINT_MAX = 5;
+
+constexpr size_t deltaBatchFrameSize(size_t count, size_t channels) {
+  // Worst case: every delta needs a full 5-byte varint
+  return DELTA_HEADER_SIZE + 8 * channels + (4 + 4 * channels) +
+         (count > 0 ? (count - 1) * (VARINT_MAX * (1 + channels)) : 0) + 2;
+}
+
+// Command frame (type 0x10, server -> device): header, opcode byte,
+// a fixed-size payload per opcode, CRC-16 over everything before it.
+// Only the hot commands get opcodes - anything configuration-shaped
+// stays JSON, where a parse taking a millisecond does not matter.
+constexpr uint8_t CMD_STOP_TEST = 0x01;   // no payload; the abort path
+constexpr uint8_t CMD_START_TEST = 0x02;  // no payload
+constexpr uint8_t CMD_TARE = 0x03;        // no payload
+constexpr uint8_t CMD_CALIBRATE = 0x04;   // f32 known_mass_g, u8 channel
+constexpr uint8_t CMD_RESEND = 0x05;      // u32 from, u16 count
+
+constexpr size_t COMMAND_HEADER_SIZE = HEADER_SIZE + 1;  // + opcode
+
+constexpr size_t commandFrameSize(size_t payloadLen) {
+  return COMMAND_HEADER_SIZE + payloadLen + 2;
+}
+
+/**
+ * CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF, no reflection).
+ */
+inline uint16_t crc16(const uint8_t* data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      if (crc & 0x8000) {
+        crc = (crc << 1) ^ 0x1021;
+      } else {
+        crc <<= 1;
+      }
+    }
+  }
+  return crc;
+}
+
+// Little-endian primitive writers. Byte-by-byte stores keep the encoder
+// free of alignment and endianness assumptions.
+inline size_t putU16(uint8_t* buf, uint16_t v) {
+  buf[0] = (uint8_t)(v & 0xFF);
+  buf[1] = (uint8_t)(v >> 8);
+  return 2;
+}
+
+inline size_t putU32(uint8_t* buf, uint32_t v) {
+  buf[0] = (uint8_t)(v & 0xFF);
+  buf[1] = (uint8_t)((v >> 8) & 0xFF);
+  buf[2] = (uint8_t)((v >> 16) & 0xFF);
+  buf[3] = (uint8_t)((v >> 24) & 0xFF);
+  return 4;
+}
+
+inline size_t putI32(uint8_t* buf, int32_t v) {
+  return putU32(buf, (uint32_t)v);
+}
+
+inline size_t putFloat(uint8_t* buf, float v) {
+  uint32_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  return putU32(buf, bits);
+}
+
+// Matching readers, for the device side of the command protocol.
+inline uint16_t getU16(const uint8_t* buf) {
+  return (uint16_t)(buf[0] | ((uint16_t)buf[1] << 8));
+}
+
+inline uint32_t getU32(const uint8_t* buf) {
+  return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) |
+         ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+inline float getFloat(const uint8_t* buf) {
+  uint32_t bits = getU32(buf);
+  float v;
+  memcpy(&v, &bits, sizeof(v));
+  return v;
+}
+
+// Zigzag maps signed deltas to unsigned so small magnitudes of either
+// sign varint-encode short: 0,-1,1,-2,2 -> 0,1,2,3,4.
+inline uint32_t zigzag32(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+inline int32_t unzigzag32(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+// LEB128 varint: 7 bits per byte, high bit flags continuation.
+inline size_t putVarint(uint8_t* buf, uint32_t v) {
+  size_t pos = 0;
+  while (v >= 0x80) {
+    buf[pos++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  buf[pos++] = (uint8_t)v;
+  return pos;
+}
+
+/** Decode a varint from buf (at most len bytes). Returns bytes
+ *  consumed, or 0 on a truncated or oversized encoding. */
+inline size_t getVarint(const uint8_t* buf, size_t len, uint32_t* out) {
+  uint32_t v = 0;
+  for (size_t i = 0; i < len && i < VARINT_MAX; i++) {
+    v |= (uint32_t)(buf[i] & 0x7F) << (7 * i);
+    if ((buf[i] & 0x80) == 0) {
+      *out = v;
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Encode one command into buf. buf must hold
+ * commandFrameSize(payloadLen) bytes. Returns the number of bytes
+ * written.
+ */
+inline size_t encodeCommand(uint8_t* buf, uint8_t opcode,
+                            const uint8_t* payload, size_t payloadLen) {
+  size_t pos = 0;
+  buf[pos++] = MAGIC0;
+  buf[pos++] = MAGIC1;
+  buf[pos++] = VERSION;
+  buf[pos++] = FRAME_COMMAND;
+  buf[pos++] = opcode;
+  for (size_t i = 0; i < payloadLen; i++) {
+    buf[pos++] = payload[i];
+  }
+  pos += putU16(buf + pos, crc16(buf, pos));
+  return pos;
+}
+
+/**
+ * Encode one reading into buf. buf must hold READING_FRAME_SIZE bytes.
+ * Returns the number of bytes written.
+ */
+inline size_t encodeReading(uint8_t* buf, uint32_t seq, uint32_t timestamp_us,
+                            int32_t raw, float force_n) {
+  size_t pos = 0;
+  buf[pos++] = MAGIC0;
+  buf[pos++] = MAGIC1;
+  buf[pos++] = VERSION;
+  buf[pos++] = FRAME_READING;
+  pos += putU32(buf + pos, seq);
+  pos += putU32(buf + pos, timestamp_us);
+  pos += putI32(buf + pos, raw);
+  pos += putFloat(buf + pos, force_n);
+  pos += putU16(buf + pos, crc16(buf, pos));
+  return pos;
+}
+
+/**
+ * Incremental encoder for batch frames. The caller owns the buffer
+ * (sized with batchFrameSize), so repeated batches reuse the same
+ * static storage and the send path stays allocation-free.
+ *
+ *   encoder.begin(firstSeq);
+ *   while (...) encoder.add(ts, raw, force);
+ *   size_t len = encoder.finish();   // writes count + CRC
+ *
+ * With channels > 1 the encoder emits multi-channel frames and add()
+ * takes per-channel arrays.
+ */
+class BatchEncoder {
+ public:
+  BatchEncoder(uint8_t* buf, size_t maxSamples, uint8_t channels = 1)
+      : buf_(buf), maxSamples_(maxSamples), channels_(channels), count_(0),
+        pos_(0) {}
+
+  void begin(uint32_t firstSeq) {
+    pos_ = 0;
+    count_ = 0;
+    buf_[pos_++] = MAGIC0;
+    buf_[pos_++] = MAGIC1;
+    buf_[pos_++] = VERSION;
+    buf_[pos_++] = (channels_ > 1) ? FRAME_BATCH_MC : FRAME_BATCH;
+    pos_ += putU32(buf_ + pos_, firstSeq);
+    pos_ += 2;  // count written in finish()
+    if (channels_ > 1) {
+      buf_[pos_++] = channels_;
+    }
+  }
+
+  bool add(uint32_t timestamp_us, const int32_t* raw, const float* force_n) {
+    if (count_ >= maxSamples_) {
+      return false;
+    }
+    pos_ += putU32(buf_ + pos_, timestamp_us);
+    for (uint8_t ch = 0; ch < channels_; ch++) {
+      pos_ += putI32(buf_ + pos_, raw[ch]);
+      pos_ += putFloat(buf_ + pos_, force_n[ch]);
+    }
+    count_++;
+    return true;
+  }
+
+  bool add(uint32_t timestamp_us, int32_t raw, float force_n) {
+    return add(timestamp_us, &raw, &force_n);
+  }
+
+  size_t finish() {
+    putU16(buf_ + HEADER_SIZE + 4, (uint16_t)count_);
+    pos_ += putU16(buf_ + pos_, crc16(buf_, pos_));
+    return pos_;
+  }
+
+  size_t count() const { return count_; }
+  bool full() const { return count_ >= maxSamples_; }
+
+ private:
+  uint8_t* buf_;
+  size_t maxSamples_;
+  uint8_t channels_;
+  size_t count_;
+  size_t pos_;
+};
+
+/**
+ * Incremental encoder for delta-compressed batch frames, same calling
+ * pattern as BatchEncoder but sized with deltaBatchFrameSize and
+ * handed the calibration at begin() so the decoder can reconstruct
+ * force from raw counts:
+ *
+ *   encoder.begin(firstSeq, scale, offset);
+ *   while (...) encoder.add(ts, raw);
+ *   size_t len = encoder.finish();
+ */
+class DeltaBatchEncoder {
+ public:
+  DeltaBatchEncoder(uint8_t* buf, size_t maxSamples, uint8_t channels = 1)
+      : buf_(buf), maxSamples_(maxSamples), channels_(channels), count_(0),
+        pos_(0) {}
+
+  void begin(uint32_t firstSeq, const float* scale, const long* offset) {
+    pos_ = 0;
+    count_ = 0;
+    buf_[pos_++] = MAGIC0;
+    buf_[pos_++] = MAGIC1;
+    buf_[pos_++] = VERSION;
+    buf_[pos_++] = FRAME_BATCH_D;
+    pos_ += putU32(buf_ + pos_, firstSeq);
+    pos_ += 2;  // count written in finish()
+    buf_[pos_++] = channels_;
+    pos_ += 2;  // payload length written in finish()
+    for (uint8_t ch = 0; ch < channels_; ch++) {
+      pos_ += putFloat(buf_ + pos_, scale[ch]);
+      pos_ += putI32(buf_ + pos_, (int32_t)offset[ch]);
+    }
+  }
+
+  bool add(uint32_t timestamp_us, const int32_t* raw) {
+    if (count_ >= maxSamples_) {
+      return false;
+    }
+    if (count_ == 0) {
+      // Absolute keyframe sample opens every frame
+      pos_ += putU32(buf_ + pos_, timestamp_us);
+      for (uint8_t ch = 0; ch < channels_; ch++) {
+        pos_ += putI32(buf_ + pos_, raw[ch]);
+      }
+    } else {
+      pos_ += putVarint(buf_ + pos_,
+                        zigzag32((int32_t)(timestamp_us - lastTimestamp_)));
+      for (uint8_t ch = 0; ch < channels_; ch++) {
+        pos_ += putVarint(buf_ + pos_, zigzag32(raw[ch] - lastRaw_[ch]));
+      }
+    }
+    lastTimestamp_ = timestamp_us;
+    for (uint8_t ch = 0; ch < channels_; ch++) {
+      lastRaw_[ch] = raw[ch];
+    }
+    count_++;
+    return true;
+  }
+
+  bool add(uint32_t timestamp_us, int32_t raw) {
+    return add(timestamp_us, &raw);
+  }
+
+  size_t finish() {
+    putU16(buf_ + HEADER_SIZE + 4, (uint16_t)count_);
+    size_t payloadStart = DELTA_HEADER_SIZE + 8 * (size_t)channels_;
+    putU16(buf_ + DELTA_HEADER_SIZE - 2, (uint16_t)(pos_ - payloadStart));
+    pos_ += putU16(buf_ + pos_, crc16(buf_, pos_));
+    return pos_;
+  }
+
+  size_t count() const { return count_; }
+  bool full() const { return count_ >= maxSamples_; }
+
+ private:
+  static const uint8_t MAX_CH = 8;
+
+  uint8_t* buf_;
+  size_t maxSamples_;
+  uint8_t channels_;
+  size_t count_;
+  size_t pos_;
+  uint32_t lastTimestamp_ = 0;
+  int32_t lastRaw_[MAX_CH] = {0};
+};
+
+}  // namespace wire
+
+#endif  // WIRE_FORMAT_H
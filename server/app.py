@@ -6,6 +6,8 @@ from flask_sock import Sock
 from flask_cors import CORS
 import os
 import json
+import socket
+import threading
 from datetime import datetime
 
 from config import Config
@@ -13,6 +15,7 @@ from models import Database
 from websocket_handler import WebSocketHandler
 from pdf_report import TestReportGenerator
 from analysis import ThrustAnalyzer
+import wire_format
 
 # Initialize Flask app
 app = Flask(__name__, static_folder='static', template_folder='static')
@@ -297,16 +300,95 @@ def calibration():
             }), 500
 
 
+def _save_uploaded_log():
+    """Analyze and store a bulk-uploaded black-box log as a test."""
+    ws_handler.test_data = ws_handler.upload_data
+    ws_handler.test_start_time = datetime.now().timestamp()
+    ws_handler.test_label = f'blackbox {ws_handler.upload_file}'
+
+    analysis = ws_handler._analyze_test()
+    test_id = ws_handler._save_test(analysis)
+
+    socketio.emit('test_complete', {
+        'test_id': test_id,
+        'analysis': analysis
+    }, namespace='/dashboard')
+
+    ws_handler.upload_data = []
+    ws_handler.test_data = []
+
+
+# Resend requests are capped so a long outage cannot trigger an
+# unbounded replay; the device ring only holds a few seconds anyway
+MAX_RESEND_SAMPLES = 1000
+
+
+def _check_seq_gap(message, dev):
+    """Spot missing sequence numbers and ask the device to resend them.
+
+    Resent (and reordered UDP) frames show up with sequence numbers at
+    or below the highest seen; those just fill in and never re-trigger
+    a request."""
+    seq = message.get('seq')
+    if seq is None:
+        return
+    last = dev.last_seq
+    if last is None or seq <= last:
+        if last is None:
+            dev.last_seq = seq
+        return
+    if seq > last + 1:
+        missing = min(seq - last - 1, MAX_RESEND_SAMPLES)
+        print(f"Sample gap on {dev.device_id}: seq {last + 1}..{seq - 1}, "
+              f"requesting resend of {missing}")
+        ws_handler.send_command_to_esp32({
+            'type': 'resend',
+            'from': last + 1,
+            'count': missing,
+        }, device=dev.device_id)
+    dev.last_seq = seq
+
+
+def _handle_esp32_reading(message, dev):
+    """Process a decoded reading (JSON or binary) from one stand."""
+    # Binary frames do not carry the sender; attribute them to their
+    # connection (JSON readings already name it, the overwrite agrees)
+    message['device'] = dev.device_id
+
+    # Add server timestamp
+    message['server_time'] = datetime.now().timestamp()
+
+    _check_seq_gap(message, dev)
+
+    # Microsecond device timestamps (wire v2): unwrap the 32-bit counter,
+    # present milliseconds to downstream consumers, and attach wall time
+    # once the clock sync has an offset estimate. Wall time is the
+    # shared timebase - readings from different stands with wall
+    # timestamps overlay directly
+    if 'timestamp_us' in message:
+        device_us = dev.clock.unwrap(message['timestamp_us'])
+        message['timestamp'] = device_us / 1000.0
+        wall = dev.clock.wall_time(device_us)
+        if wall is not None:
+            message['wall_time'] = wall
+
+    # If recording, buffer the data
+    if ws_handler.recording:
+        ws_handler.test_data.append(message)
+
+    # Broadcast to all dashboards via Socket.IO
+    socketio.emit('reading', message, namespace='/dashboard')
+
+
 # Plain WebSocket endpoint for ESP32
 @sock.route('/esp32')
 def esp32_websocket(ws):
     """Handle plain WebSocket connection from ESP32."""
-    print("ESP32 connected via plain WebSocket")
-    ws_handler.esp32_connected = True
-    ws_handler.esp32_ws = ws  # Store reference for sending commands
-
-    # Notify dashboards
-    socketio.emit('esp32_status', {'connected': True}, namespace='/dashboard')
+    # Registered under a placeholder until the first message announces
+    # the persisted device ID
+    addr = request.remote_addr
+    dev = ws_handler.register_device(f'stand@{addr}', ws=ws, addr=addr)
+    print(f"ESP32 connected via plain WebSocket from {addr}")
 
     try:
         while True:
@@ -315,21 +397,152 @@ def esp32_websocket(ws):
             if data is None:
                 break
 
+            # Binary frames (negotiated via hello/set_format)
+            if isinstance(data, (bytes, bytearray)):
+                try:
+                    readings = wire_format.decode_frames(bytes(data))
+                    if ws_handler.uploading:
+                        # Bulk transfer of a black-box log
+                        ws_handler.upload_data.extend(readings)
+                        if ws_handler.replaying:
+                            # Cumulative ack keeps the device's send
+                            # window full - the backpressure channel
+                            ws_handler.replay_frames += 1
+                            ws.send(json.dumps({
+                                'type': 'replay_ack',
+                                'frames': ws_handler.replay_frames,
+                            }))
+                    else:
+                        for reading in readings:
+                            _handle_esp32_reading(reading, dev)
+                except wire_format.FrameError as e:
+                    print(f"Binary frame error: {e}")
+                continue
+
             # Parse JSON
             try:
                 message = json.loads(data)
 
+                # Every firmware message names its sender; adopt the
+                # announced ID in place of the placeholder
+                announced = message.get('device')
+                if announced:
+                    ws_handler.rename_device(dev, announced)
+
                 # Handle different message types
                 if message.get('type') == 'reading':
-                    # Add server timestamp
-                    message['server_time'] = datetime.now().timestamp()
-
-                    # If recording, buffer the data
-                    if ws_handler.recording:
-                        ws_handler.test_data.append(message)
-
-                    # Broadcast to all dashboards via Socket.IO
-                    socketio.emit('reading', message, namespace='/dashboard')
+                    _handle_esp32_reading(message, dev)
+
+                elif message.get('type') == 'log_upload_begin':
+                    ws_handler.uploading = True
+                    ws_handler.upload_data = []
+                    ws_handler.upload_file = message.get('file')
+                    print(f"Black-box upload started: {ws_handler.upload_file} "
+                          f"({message.get('samples')} samples)")
+
+                elif message.get('type') == 'log_upload_end':
+                    ws_handler.uploading = False
+                    print(f"Black-box upload finished: {ws_handler.upload_file} "
+                          f"({len(ws_handler.upload_data)} samples received)")
+                    if ws_handler.upload_data:
+                        _save_uploaded_log()
+
+                elif message.get('type') == 'replay_begin':
+                    # Like an upload, but flow-controlled: each binary
+                    # frame gets a cumulative replay_ack back
+                    ws_handler.uploading = True
+                    ws_handler.replaying = True
+                    ws_handler.replay_frames = 0
+                    ws_handler.upload_data = []
+                    ws_handler.upload_file = message.get('file')
+                    print(f"Replay started: {ws_handler.upload_file} "
+                          f"({message.get('samples')} samples, window "
+                          f"{message.get('window')})")
+
+                elif message.get('type') == 'replay_end':
+                    ws_handler.uploading = False
+                    ws_handler.replaying = False
+                    print(f"Replay finished: {ws_handler.upload_file} - "
+                          f"{message.get('samples')} samples, "
+                          f"{message.get('bytes')} bytes in "
+                          f"{message.get('elapsed_ms')} ms "
+                          f"({message.get('kbps')} kbit/s)")
+                    if ws_handler.upload_data:
+                        _save_uploaded_log()
+
+                elif message.get('type') == 'log_list':
+                    # Forward the device's stored-log inventory
+                    socketio.emit('log_list', message, namespace='/dashboard')
+
+                elif message.get('type') == 'calibration_complete':
+                    # Tare/calibration runs asynchronously on the
+                    # device now; this is the completion notification
+                    # with the resulting offset or scale factor
+                    print(f"Calibration complete: {message}")
+                    socketio.emit('calibration_complete', message,
+                                  namespace='/dashboard')
+
+                elif message.get('type') == 'calibration_aborted':
+                    # The device dropped an in-progress tare/calibration
+                    # because a test started mid-averaging
+                    print(f"Calibration aborted: {message}")
+                    socketio.emit('calibration_aborted', message,
+                                  namespace='/dashboard')
+
+                elif message.get('type') == 'live_stats':
+                    # Once-per-second on-device analysis summary
+                    # (running impulse, peak, burn edges) for the
+                    # dashboards' live view
+                    socketio.emit('live_stats', message, namespace='/dashboard')
+
+                elif message.get('type') == 'stats':
+                    # Device health (ring high-water mark, drops) for
+                    # the dashboards
+                    socketio.emit('device_stats', message, namespace='/dashboard')
+
+                elif message.get('type') == 'time_sync':
+                    # Clock sync leg 2: stamp the exchange and echo t0
+                    t0 = message.get('t0')
+                    dev.clock.note_sync_request(
+                        t0, datetime.now().timestamp())
+                    ws.send(json.dumps({'type': 'time_sync_ack', 't0': t0}))
+
+                elif message.get('type') == 'time_sync_result':
+                    # Clock sync leg 3: device reports when the ack
+                    # arrived; fold into the offset estimate
+                    rtt = dev.clock.complete_sync(
+                        message.get('t0'), message.get('t2'))
+                    if rtt is not None:
+                        print(f"Clock sync {dev.device_id}: rtt {rtt} us, "
+                              f"offset {dev.clock.offset:.6f} s")
+
+                elif message.get('type') == 'hello':
+                    # Device announces supported wire formats and
+                    # transports; opt in to binary (and the UDP stream,
+                    # if configured) when the firmware offers them
+                    reset_reason = message.get('reset_reason')
+                    if reset_reason not in (None, 'poweron', 'sw'):
+                        print(f"{dev.device_id} rebooted uncleanly: "
+                              f"{reset_reason}")
+                    formats = message.get('formats', [])
+                    transports = message.get('transports', [])
+                    compressions = message.get('compressions', [])
+                    if 'binary' in formats and Config.ESP32_WIRE_FORMAT == 'binary':
+                        reply = {'type': 'set_format', 'format': 'binary'}
+                        if ('udp' in transports
+                                and Config.ESP32_TRANSPORT == 'udp'):
+                            reply['transport'] = 'udp'
+                            reply['port'] = Config.ESP32_UDP_PORT
+                            print(f"ESP32 streaming UDP to port "
+                                  f"{Config.ESP32_UDP_PORT}")
+                        if ('delta' in compressions
+                                and Config.ESP32_COMPRESSION == 'delta'):
+                            reply['compression'] = 'delta'
+                            print("ESP32 stream compression set to delta")
+                        ws.send(json.dumps(reply))
+                        print("ESP32 wire format set to binary")
+                    else:
+                        print("ESP32 wire format left as JSON")
 
             except json.JSONDecodeError as e:
                 print(f"JSON decode error: {e}")
@@ -337,10 +550,33 @@ def esp32_websocket(ws):
     except Exception as e:
         print(f"ESP32 WebSocket error: {e}")
     finally:
-        print("ESP32 disconnected")
-        ws_handler.esp32_connected = False
-        ws_handler.esp32_ws = None  # Clear reference
-        socketio.emit('esp32_status', {'connected': False}, namespace='/dashboard')
+        print(f"ESP32 disconnected: {dev.device_id}")
+        ws_handler.unregister_device(dev)
+
+
+def _esp32_udp_listener():
+    """Receive binary sample frames streamed as UDP datagrams.
+
+    The low-latency alternative to the WebSocket: a lost datagram costs
+    its batch and nothing behind it (no TCP head-of-line blocking).
+    Commands, stats and black-box uploads stay on the WebSocket, which
+    remains the reliable channel."""
+    udp = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    udp.bind(('0.0.0.0', Config.ESP32_UDP_PORT))
+    print(f"ESP32 UDP stream listener on port {Config.ESP32_UDP_PORT}")
+
+    while True:
+        data, addr = udp.recvfrom(4096)
+        # Datagrams are attributed by source address to the stand whose
+        # WebSocket (the negotiation channel) came from the same host
+        dev = ws_handler.device_for_addr(addr[0])
+        if dev is None:
+            continue
+        try:
+            for reading in wire_format.decode_frames(data):
+                _handle_esp32_reading(reading, dev)
+        except wire_format.FrameError as e:
+            print(f"UDP frame error: {e}")
 
 
 @app.errorhandler(404)
@@ -366,6 +602,10 @@ if __name__ == '__main__':
     print("Rocket Motor Test Stand Server")
     print("=" * 60)
     print(f"Database: {Config.DATABASE_PATH}")
+
+    if Config.ESP32_TRANSPORT == 'udp':
+        threading.Thread(target=_esp32_udp_listener, daemon=True).start()
+
     print(f"Server starting on http://0.0.0.0:5000")
     print("ESP32 WebSocket: ws://[server-ip]:5000/esp32")
     print("Dashboard WebSocket: ws://[server-ip]:5000/dashboard")
@@ -25,3 +25,9 @@ class Config:
 
     # Sampling
     EXPECTED_SAMPLE_RATE = 80  # Hz
+
+    # ESP32 link
+    ESP32_WIRE_FORMAT = 'binary'  # 'binary' or 'json' (JSON is the fallback)
+    ESP32_TRANSPORT = 'websocket'  # 'udp' streams samples as datagrams
+    ESP32_UDP_PORT = 5005  # listener port for the UDP stream
+    ESP32_COMPRESSION = 'delta'  # 'delta' or 'none' (delta-varint batches)
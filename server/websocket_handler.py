@@ -6,6 +6,37 @@ import time
 from analysis import ThrustAnalyzer
 from models import Database
 from config import Config
+import wire_format
+
+
+class DeviceState:
+    """Per-stand connection state.
+
+    Up to four stands share one server for comparative burns, so each
+    connection carries its own clock tracking and sequence continuity
+    rather than the server assuming a single device. Keyed by the
+    device ID the firmware persists in NVS and announces in hello;
+    every JSON message names its sender, binary frames are attributed
+    to their WebSocket connection (or, for the UDP stream, to their
+    source address)."""
+
+    def __init__(self, device_id: str, ws=None, addr: str = None):
+        self.device_id = device_id
+        self.ws = ws  # Plain WebSocket connection from the stand
+        self.addr = addr  # Remote IP; attributes UDP datagrams
+        self.connected = True
+
+        # Last sample sequence number seen, used to spot gaps and ask
+        # this stand to resend from its retransmit ring. Fresh per
+        # connection (seq restarts on boot)
+        self.last_seq = None
+
+        # Unwraps the 32-bit microsecond frame timestamps and holds the
+        # device-to-wall-time offset from the time_sync exchange. Wall
+        # time is the shared timebase: two stands' readings with wall
+        # timestamps overlay directly. Fresh per connection (the device
+        # clock restarts on reboot)
+        self.clock = wire_format.DeviceClock()
 
 
 class WebSocketHandler:
@@ -16,26 +47,120 @@ class WebSocketHandler:
         self.db = db
         self.config = config
 
+        # Connected stands, keyed by device ID. A single-stand setup is
+        # simply a dict with one entry
+        self.devices = {}
+
         # State management
-        self.esp32_connected = False
-        self.esp32_ws = None  # Plain WebSocket connection from ESP32
         self.recording = False
         self.test_data = []
         self.test_start_time = None
         self.test_label = None
 
+        # Black-box upload: while True, binary frames from the ESP32
+        # belong to a stored log being bulk-transferred, not the live
+        # trace. One upload runs at a time (it is dashboard-initiated)
+        self.uploading = False
+        self.upload_data = []
+        self.upload_file = None
+
+        # Flow-controlled replay: while True, every binary frame is
+        # acknowledged with a cumulative count so the device can keep
+        # its send window full without overrunning the socket
+        self.replaying = False
+        self.replay_frames = 0
+
         # Register handlers
         self._register_handlers()
 
-    def send_command_to_esp32(self, command: Dict):
-        """Send command to ESP32 via plain WebSocket."""
-        if self.esp32_ws is not None:
+    @property
+    def esp32_connected(self) -> bool:
+        """True while at least one stand is connected."""
+        return any(dev.connected for dev in self.devices.values())
+
+    def _status_event(self) -> Dict:
+        return {
+            'connected': self.esp32_connected,
+            'devices': sorted(dev.device_id for dev in self.devices.values()
+                              if dev.connected),
+        }
+
+    def register_device(self, device_id: str, ws=None,
+                        addr: str = None) -> DeviceState:
+        """Track a newly connected stand (or a reconnect of a known one)."""
+        dev = self.devices.get(device_id)
+        if dev is None:
+            dev = DeviceState(device_id, ws=ws, addr=addr)
+            self.devices[device_id] = dev
+        else:
+            dev.ws = ws
+            dev.addr = addr
+            dev.connected = True
+            dev.last_seq = None
+            dev.clock = wire_format.DeviceClock()
+        self.socketio.emit('esp32_status', self._status_event(),
+                           namespace='/dashboard')
+        return dev
+
+    def rename_device(self, dev: DeviceState, device_id: str):
+        """Adopt the ID the firmware announced.
+
+        A connection is registered under a placeholder until the first
+        message names its sender."""
+        if device_id == dev.device_id:
+            return
+        self.devices.pop(dev.device_id, None)
+        # Displace any stale entry left by a previous connection of
+        # the same stand
+        dev.device_id = device_id
+        self.devices[device_id] = dev
+        self.socketio.emit('esp32_status', self._status_event(),
+                           namespace='/dashboard')
+
+    def unregister_device(self, dev: DeviceState):
+        dev.connected = False
+        dev.ws = None
+        self.socketio.emit('esp32_status', self._status_event(),
+                           namespace='/dashboard')
+
+    def device_for_addr(self, ip: str) -> DeviceState:
+        """Attribute a UDP datagram to the stand streaming from ip."""
+        for dev in self.devices.values():
+            if dev.connected and dev.addr == ip:
+                return dev
+        return None
+
+    def send_command_to_esp32(self, command: Dict, device: str = None):
+        """Send a command to one stand, or to every connected stand.
+
+        Dashboard actions without an explicit device target go to all
+        stands - for a comparative burn, start_test has to reach every
+        stand at once."""
+        if device is not None:
+            dev = self.devices.get(device)
+            targets = [dev] if dev and dev.connected else []
+        else:
+            targets = [d for d in self.devices.values() if d.connected]
+        if not targets:
+            print(f"No connected device for command: {command}")
+            return
+
+        for dev in targets:
             try:
-                import json
-                self.esp32_ws.send(json.dumps(command))
-                print(f"Sent command to ESP32: {command}")
+                # Hot commands go as binary frames the device dispatches
+                # without a JSON parse; everything else (and any device
+                # still on the JSON format) uses the JSON path
+                frame = None
+                if self.config.ESP32_WIRE_FORMAT == 'binary':
+                    frame = wire_format.encode_command(command)
+                if frame is not None:
+                    dev.ws.send(frame)
+                else:
+                    import json
+                    dev.ws.send(json.dumps(command))
+                print(f"Sent command to {dev.device_id}: {command}")
             except Exception as e:
-                print(f"Error sending command to ESP32: {e}")
+                print(f"Error sending command to {dev.device_id}: {e}")
 
     def _register_handlers(self):
         """Register all WebSocket event handlers."""
@@ -43,14 +168,12 @@ class WebSocketHandler:
         # ESP32 namespace
         @self.socketio.on('connect', namespace='/esp32')
         def esp32_connect():
-            self.esp32_connected = True
             print("ESP32 connected")
             # Notify dashboards
             self.socketio.emit('esp32_status', {'connected': True}, namespace='/dashboard')
 
         @self.socketio.on('disconnect', namespace='/esp32')
         def esp32_disconnect():
-            self.esp32_connected = False
             print("ESP32 disconnected")
             # Notify dashboards
             self.socketio.emit('esp32_status', {'connected': False}, namespace='/dashboard')
@@ -110,18 +233,28 @@ class WebSocketHandler:
             # Notify ESP32
             self.send_command_to_esp32({'type': 'stop_test'})
 
-            # Process and analyze data
+            # Process and analyze data. A comparative burn records
+            # several stands at once; each stand becomes its own test
             if len(self.test_data) > 0:
-                analysis = self._analyze_test()
-
-                # Save to database
-                test_id = self._save_test(analysis)
-
-                # Send results to dashboards
-                self.socketio.emit('test_complete', {
-                    'test_id': test_id,
-                    'analysis': analysis
-                }, namespace='/dashboard')
+                groups = self._split_by_device()
+                base_label = self.test_label
+                for device_id, readings in groups:
+                    self.test_data = readings
+                    if device_id is not None and len(groups) > 1:
+                        self.test_label = (f'{base_label} ({device_id})'
+                                           if base_label else device_id)
+                    analysis = self._analyze_test()
+
+                    # Save to database
+                    test_id = self._save_test(analysis)
+
+                    # Send results to dashboards
+                    self.socketio.emit('test_complete', {
+                        'test_id': test_id,
+                        'device': device_id,
+                        'analysis': analysis
+                    }, namespace='/dashboard')
+                self.test_label = base_label
             else:
                 emit('error', {'message': 'No data recorded'})
 
@@ -129,14 +262,15 @@ class WebSocketHandler:
             self.socketio.emit('recording_status', {'recording': False}, namespace='/dashboard')
 
         @self.socketio.on('tare', namespace='/dashboard')
-        def handle_tare():
+        def handle_tare(data=None):
             """Send tare command to ESP32."""
             if not self.esp32_connected:
                 emit('error', {'message': 'ESP32 not connected'})
                 return
 
             print("Tare command sent")
-            self.send_command_to_esp32({'type': 'tare'})
+            self.send_command_to_esp32({'type': 'tare'},
+                                       device=(data or {}).get('device'))
             emit('message', {'text': 'Tare command sent'})
 
         @self.socketio.on('calibrate', namespace='/dashboard')
@@ -155,9 +289,23 @@ class WebSocketHandler:
             self.send_command_to_esp32({
                 'type': 'calibrate',
                 'known_mass': known_mass
-            })
+            }, device=data.get('device'))
             emit('message', {'text': f'Calibration with {known_mass}g sent'})
 
+        @self.socketio.on('set_filter', namespace='/dashboard')
+        def handle_set_filter(data):
+            """Configure the ESP32's send-path filter/decimation."""
+            if not self.esp32_connected:
+                emit('error', {'message': 'ESP32 not connected'})
+                return
+
+            command = {'type': 'set_filter'}
+            command.update(data or {})
+            device = command.pop('device', None)
+            print(f"Filter command sent: {command}")
+            self.send_command_to_esp32(command, device=device)
+            emit('message', {'text': 'Filter configuration sent'})
+
         @self.socketio.on('get_tests', namespace='/dashboard')
         def handle_get_tests():
             """Retrieve test history."""
@@ -178,8 +326,27 @@ class WebSocketHandler:
             else:
                 emit('error', {'message': f'Test {test_id} not found'})
 
+    def _split_by_device(self) -> List:
+        """Group buffered readings by originating stand.
+
+        Mixing two stands' samples would corrupt the analysis, so each
+        stand's stream is analyzed and stored separately. Readings
+        without a device tag (old firmware) fall into one group."""
+        groups = {}
+        for reading in self.test_data:
+            groups.setdefault(reading.get('device'), []).append(reading)
+        return sorted(groups.items(),
+                      key=lambda kv: (kv[0] is None, kv[0] or ''))
+
     def _analyze_test(self) -> Dict:
         """Analyze recorded test data."""
+        # Resent samples arrive after the gap they repair, so restore
+        # acquisition order before analysis
+        if all('seq' in r for r in self.test_data):
+            self.test_data.sort(key=lambda r: r['seq'])
+        else:
+            self.test_data.sort(key=lambda r: r['timestamp'])
+
         # Extract time and force arrays
         time_data = []
         force_data = []
@@ -220,6 +387,8 @@ class WebSocketHandler:
         """Get current system status."""
         return {
             'esp32_connected': self.esp32_connected,
+            'devices': sorted(dev.device_id for dev in self.devices.values()
+                              if dev.connected),
             'recording': self.recording,
             'data_points': len(self.test_data) if self.recording else 0
         }
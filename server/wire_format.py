@@ -0,0 +1,481 @@
+"""Binary wire format decoder for ESP32 sensor frames.
+
+Mirror of firmware/src/wire_format.h. The ESP32 announces supported
+formats in a JSON "hello" at connect time; the server replies with
+"set_format" and the device switches to packed binary frames.
+
+Reading frame v2 (little-endian, 22 bytes):
+
+    offset  size  field
+    0       2     magic "RT"
+    2       1     format version (2)
+    3       1     frame type (0x01 = reading)
+    4       4     sequence number (uint32)
+    8       4     timestamp, us since boot (uint32, low 32 bits of the
+                  device's 64-bit clock; wraps every ~71 minutes)
+    12      4     raw ADC value (int32)
+    16      4     force in newtons (float32)
+    20      2     CRC-16/CCITT-FALSE over bytes 0..19
+
+v1 carried millisecond timestamps; v2 switched to microseconds. The
+DeviceClock below unwraps the 32-bit counter and, fed by the device's
+periodic time_sync exchange, maps device time to wall time.
+
+Batch frame v1 (frame type 0x02) carries N samples in one frame:
+
+    offset  size  field
+    0       4     magic, version, frame type (as above)
+    4       4     sequence number of first sample (uint32)
+    8       2     sample count N (uint16)
+    10      12*N  samples: timestamp (uint32), raw (int32), force (float32)
+    10+12N  2     CRC-16/CCITT-FALSE over everything before it
+
+Samples in a batch have consecutive sequence numbers starting at the
+first.
+
+Multi-channel batch frame (frame type 0x03) is the same with a channel
+count byte after the sample count; each sample is the timestamp
+followed by one (raw, force) pair per channel. Channel 0 is the axial
+(thrust) cell. Single-channel devices keep sending type 0x02 frames.
+"""
+
+import struct
+from typing import Dict, List
+
+MAGIC = b'RT'
+VERSION = 2
+
+FRAME_READING = 0x01
+FRAME_BATCH = 0x02
+FRAME_BATCH_MC = 0x03
+FRAME_BATCH_D = 0x04
+FRAME_COMMAND = 0x10
+
+# Command opcodes (server -> device). Only the hot commands have
+# opcodes; configuration-shaped commands stay JSON.
+CMD_STOP_TEST = 0x01
+CMD_START_TEST = 0x02
+CMD_TARE = 0x03
+CMD_CALIBRATE = 0x04  # payload: f32 known_mass_g, u8 channel
+CMD_RESEND = 0x05     # payload: u32 from, u16 count
+
+READING_FRAME_SIZE = 22
+BATCH_SAMPLE_SIZE = 12
+BATCH_HEADER_SIZE = 10
+BATCH_MC_HEADER_SIZE = 11  # + channel count byte
+BATCH_D_HEADER_SIZE = 13   # + channel count + payload length
+HEADER_SIZE_MIN = 4
+
+GRAVITY = 9.81  # matches countsToNewtons() in the firmware
+
+# magic(2s) version(B) type(B) seq(I) timestamp(I) raw(i) force(f)
+_READING_STRUCT = struct.Struct('<2sBBIIif')
+
+# magic(2s) version(B) type(B) first_seq(I) count(H)
+_BATCH_HEADER_STRUCT = struct.Struct('<2sBBIH')
+
+_SAMPLE_STRUCT = struct.Struct('<Iif')
+
+
+def crc16(data: bytes) -> int:
+    """CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF, no reflection)."""
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            if crc & 0x8000:
+                crc = ((crc << 1) ^ 0x1021) & 0xFFFF
+            else:
+                crc = (crc << 1) & 0xFFFF
+    return crc
+
+
+class FrameError(ValueError):
+    """Raised when a binary frame fails validation."""
+
+
+def decode_reading(frame: bytes) -> Dict:
+    """Decode a single reading frame into the same dict shape as the
+    JSON protocol produces, so downstream handling is format-agnostic."""
+    if len(frame) < READING_FRAME_SIZE:
+        raise FrameError(f'Short frame: {len(frame)} bytes')
+
+    magic, version, frame_type, seq, timestamp, raw, force = \
+        _READING_STRUCT.unpack(frame[:_READING_STRUCT.size])
+
+    if magic != MAGIC:
+        raise FrameError(f'Bad magic: {magic!r}')
+    if version != VERSION:
+        raise FrameError(f'Unsupported wire version: {version}')
+    if frame_type != FRAME_READING:
+        raise FrameError(f'Unexpected frame type: {frame_type:#x}')
+
+    (expected_crc,) = struct.unpack_from('<H', frame, _READING_STRUCT.size)
+    actual_crc = crc16(frame[:_READING_STRUCT.size])
+    if expected_crc != actual_crc:
+        raise FrameError(
+            f'CRC mismatch: expected {expected_crc:#06x}, got {actual_crc:#06x}')
+
+    return {
+        'type': 'reading',
+        'seq': seq,
+        'timestamp': timestamp / 1000.0,  # ms, for format-agnostic consumers
+        'timestamp_us': timestamp,
+        'raw': raw,
+        'force': round(force, 2),
+    }
+
+
+def decode_batch(frame: bytes) -> List[Dict]:
+    """Decode a batch frame into a list of reading dicts."""
+    if len(frame) < BATCH_HEADER_SIZE + 2:
+        raise FrameError(f'Short batch frame: {len(frame)} bytes')
+
+    magic, version, frame_type, first_seq, count = \
+        _BATCH_HEADER_STRUCT.unpack(frame[:BATCH_HEADER_SIZE])
+
+    if magic != MAGIC:
+        raise FrameError(f'Bad magic: {magic!r}')
+    if version != VERSION:
+        raise FrameError(f'Unsupported wire version: {version}')
+    if frame_type != FRAME_BATCH:
+        raise FrameError(f'Unexpected frame type: {frame_type:#x}')
+
+    body_size = BATCH_HEADER_SIZE + count * BATCH_SAMPLE_SIZE
+    if len(frame) < body_size + 2:
+        raise FrameError(
+            f'Batch truncated: {len(frame)} bytes for {count} samples')
+
+    (expected_crc,) = struct.unpack_from('<H', frame, body_size)
+    actual_crc = crc16(frame[:body_size])
+    if expected_crc != actual_crc:
+        raise FrameError(
+            f'CRC mismatch: expected {expected_crc:#06x}, got {actual_crc:#06x}')
+
+    readings = []
+    for i in range(count):
+        timestamp, raw, force = _SAMPLE_STRUCT.unpack_from(
+            frame, BATCH_HEADER_SIZE + i * BATCH_SAMPLE_SIZE)
+        readings.append({
+            'type': 'reading',
+            'seq': first_seq + i,
+            'timestamp': timestamp / 1000.0,  # ms
+            'timestamp_us': timestamp,
+            'raw': raw,
+            'force': round(force, 2),
+        })
+    return readings
+
+
+def decode_batch_mc(frame: bytes) -> List[Dict]:
+    """Decode a multi-channel batch frame into reading dicts.
+
+    Channel 0 fills the scalar 'raw'/'force' fields (so single-channel
+    consumers see the axial cell as before); all channels appear in the
+    'raws'/'forces' lists."""
+    if len(frame) < BATCH_MC_HEADER_SIZE + 2:
+        raise FrameError(f'Short batch frame: {len(frame)} bytes')
+
+    magic, version, frame_type, first_seq, count = \
+        _BATCH_HEADER_STRUCT.unpack(frame[:BATCH_HEADER_SIZE])
+    channels = frame[BATCH_HEADER_SIZE]
+
+    if magic != MAGIC:
+        raise FrameError(f'Bad magic: {magic!r}')
+    if version != VERSION:
+        raise FrameError(f'Unsupported wire version: {version}')
+    if frame_type != FRAME_BATCH_MC:
+        raise FrameError(f'Unexpected frame type: {frame_type:#x}')
+    if channels == 0:
+        raise FrameError('Zero channels in batch')
+
+    sample_size = 4 + channels * 8
+    body_size = BATCH_MC_HEADER_SIZE + count * sample_size
+    if len(frame) < body_size + 2:
+        raise FrameError(
+            f'Batch truncated: {len(frame)} bytes for {count} samples')
+
+    (expected_crc,) = struct.unpack_from('<H', frame, body_size)
+    actual_crc = crc16(frame[:body_size])
+    if expected_crc != actual_crc:
+        raise FrameError(
+            f'CRC mismatch: expected {expected_crc:#06x}, got {actual_crc:#06x}')
+
+    readings = []
+    for i in range(count):
+        base = BATCH_MC_HEADER_SIZE + i * sample_size
+        (timestamp,) = struct.unpack_from('<I', frame, base)
+        raws = []
+        forces = []
+        for ch in range(channels):
+            raw, force = struct.unpack_from('<if', frame, base + 4 + ch * 8)
+            raws.append(raw)
+            forces.append(round(force, 2))
+        readings.append({
+            'type': 'reading',
+            'seq': first_seq + i,
+            'timestamp': timestamp / 1000.0,  # ms
+            'timestamp_us': timestamp,
+            'raw': raws[0],
+            'force': forces[0],
+            'raws': raws,
+            'forces': forces,
+        })
+    return readings
+
+
+def _unzigzag(v: int) -> int:
+    return (v >> 1) ^ -(v & 1)
+
+
+def _get_varint(data: bytes, pos: int):
+    """Decode one LEB128 varint at pos; returns (value, next_pos)."""
+    value = 0
+    for i in range(5):
+        if pos + i >= len(data):
+            raise FrameError('Truncated varint')
+        byte = data[pos + i]
+        value |= (byte & 0x7F) << (7 * i)
+        if not byte & 0x80:
+            return value, pos + i + 1
+    raise FrameError('Oversized varint')
+
+
+def decode_batch_d(frame: bytes) -> List[Dict]:
+    """Decode a delta-compressed batch frame into reading dicts.
+
+    The frame carries raw counts only (as zigzag varints of the
+    sample-to-sample delta, after one absolute keyframe sample) plus
+    the per-channel calibration, from which force is recomputed exactly
+    as the firmware's countsToNewtons() would."""
+    if len(frame) < BATCH_D_HEADER_SIZE + 2:
+        raise FrameError(f'Short batch frame: {len(frame)} bytes')
+
+    magic, version, frame_type, first_seq, count = \
+        _BATCH_HEADER_STRUCT.unpack(frame[:BATCH_HEADER_SIZE])
+    channels = frame[BATCH_HEADER_SIZE]
+    (payload_len,) = struct.unpack_from('<H', frame, BATCH_HEADER_SIZE + 1)
+
+    if magic != MAGIC:
+        raise FrameError(f'Bad magic: {magic!r}')
+    if version != VERSION:
+        raise FrameError(f'Unsupported wire version: {version}')
+    if frame_type != FRAME_BATCH_D:
+        raise FrameError(f'Unexpected frame type: {frame_type:#x}')
+    if channels == 0:
+        raise FrameError('Zero channels in batch')
+
+    body_size = BATCH_D_HEADER_SIZE + channels * 8 + payload_len
+    if len(frame) < body_size + 2:
+        raise FrameError(
+            f'Batch truncated: {len(frame)} bytes for {count} samples')
+
+    (expected_crc,) = struct.unpack_from('<H', frame, body_size)
+    actual_crc = crc16(frame[:body_size])
+    if expected_crc != actual_crc:
+        raise FrameError(
+            f'CRC mismatch: expected {expected_crc:#06x}, got {actual_crc:#06x}')
+
+    scales = []
+    offsets = []
+    for ch in range(channels):
+        scale, cal_offset = struct.unpack_from(
+            '<fi', frame, BATCH_D_HEADER_SIZE + ch * 8)
+        scales.append(scale)
+        offsets.append(cal_offset)
+
+    def to_force(raw, ch):
+        mass_grams = (raw - offsets[ch]) / scales[ch]
+        return round(mass_grams / 1000.0 * GRAVITY, 2)
+
+    readings = []
+    pos = BATCH_D_HEADER_SIZE + channels * 8
+    timestamp = 0
+    raws = [0] * channels
+    for i in range(count):
+        if i == 0:
+            (timestamp,) = struct.unpack_from('<I', frame, pos)
+            pos += 4
+            for ch in range(channels):
+                (raws[ch],) = struct.unpack_from('<i', frame, pos)
+                pos += 4
+        else:
+            delta, pos = _get_varint(frame, pos)
+            timestamp = (timestamp + _unzigzag(delta)) & 0xFFFFFFFF
+            for ch in range(channels):
+                delta, pos = _get_varint(frame, pos)
+                raws[ch] += _unzigzag(delta)
+
+        reading = {
+            'type': 'reading',
+            'seq': first_seq + i,
+            'timestamp': timestamp / 1000.0,  # ms
+            'timestamp_us': timestamp,
+            'raw': raws[0],
+            'force': to_force(raws[0], 0),
+        }
+        if channels > 1:
+            reading['raws'] = list(raws)
+            reading['forces'] = [to_force(raws[ch], ch)
+                                 for ch in range(channels)]
+        readings.append(reading)
+    return readings
+
+
+def _frame_size(data: bytes, offset: int) -> int:
+    """Size in bytes of the frame starting at offset."""
+    frame_type = data[offset + 3]
+    if frame_type == FRAME_READING:
+        return READING_FRAME_SIZE
+    if frame_type == FRAME_BATCH:
+        if offset + BATCH_HEADER_SIZE > len(data):
+            raise FrameError('Truncated batch header')
+        (count,) = struct.unpack_from('<H', data, offset + 8)
+        return BATCH_HEADER_SIZE + count * BATCH_SAMPLE_SIZE + 2
+    if frame_type == FRAME_BATCH_MC:
+        if offset + BATCH_MC_HEADER_SIZE > len(data):
+            raise FrameError('Truncated batch header')
+        (count,) = struct.unpack_from('<H', data, offset + 8)
+        channels = data[offset + BATCH_HEADER_SIZE]
+        return BATCH_MC_HEADER_SIZE + count * (4 + channels * 8) + 2
+    if frame_type == FRAME_BATCH_D:
+        if offset + BATCH_D_HEADER_SIZE > len(data):
+            raise FrameError('Truncated batch header')
+        channels = data[offset + BATCH_HEADER_SIZE]
+        (payload_len,) = struct.unpack_from(
+            '<H', data, offset + BATCH_HEADER_SIZE + 1)
+        return BATCH_D_HEADER_SIZE + channels * 8 + payload_len + 2
+    raise FrameError(f'Unknown frame type: {frame_type:#x}')
+
+
+def decode_frames(data: bytes) -> List[Dict]:
+    """Decode a WebSocket binary payload, which may carry one or more
+    back-to-back frames, into a list of reading dicts."""
+    readings = []
+    offset = 0
+    while offset < len(data):
+        if offset + HEADER_SIZE_MIN > len(data):
+            raise FrameError('Truncated frame header')
+        size = _frame_size(data, offset)
+        frame = data[offset:offset + size]
+        if data[offset + 3] == FRAME_BATCH:
+            readings.extend(decode_batch(frame))
+        elif data[offset + 3] == FRAME_BATCH_MC:
+            readings.extend(decode_batch_mc(frame))
+        elif data[offset + 3] == FRAME_BATCH_D:
+            readings.extend(decode_batch_d(frame))
+        else:
+            readings.append(decode_reading(frame))
+        offset += size
+    return readings
+
+
+
+def encode_command(command: Dict) -> bytes:
+    """Encode a command dict as a binary command frame, or return None
+    if the command type has no opcode (caller falls back to JSON).
+
+    Layout: magic, version, type 0x10, opcode byte, a fixed payload per
+    opcode, CRC-16 over everything before it. The device dispatches
+    these through a function table with no JSON parse on the way, which
+    is what makes the stop_test abort path microseconds instead of
+    milliseconds.
+    """
+    cmd_type = command.get('type')
+    if cmd_type == 'stop_test':
+        opcode, payload = CMD_STOP_TEST, b''
+    elif cmd_type == 'start_test':
+        opcode, payload = CMD_START_TEST, b''
+    elif cmd_type == 'tare':
+        opcode, payload = CMD_TARE, b''
+    elif cmd_type == 'calibrate':
+        opcode = CMD_CALIBRATE
+        payload = struct.pack('<fB', float(command['known_mass']),
+                              int(command.get('channel', 0)))
+    elif cmd_type == 'resend':
+        opcode = CMD_RESEND
+        payload = struct.pack('<IH', int(command['from']),
+                              int(command.get('count', 1)))
+    else:
+        return None
+
+    frame = MAGIC + bytes([VERSION, FRAME_COMMAND, opcode]) + payload
+    return frame + struct.pack('<H', crc16(frame))
+
+
+class DeviceClock:
+    """Tracks the ESP32's microsecond clock.
+
+    Two jobs: unwrap the 32-bit microsecond counter carried in frames
+    (it rolls over every ~71 minutes), and estimate the offset between
+    device time and server wall time from the firmware's periodic sync
+    exchange:
+
+        device -> server   time_sync        {t0}        (device clock)
+        server -> device   time_sync_ack    {t0}        (t1 stamped here)
+        device -> server   time_sync_result {t0, t2}    (device clock)
+
+    The server wall time t1 at the ack corresponds to device time
+    (t0 + t2) / 2, assuming a symmetric path, so the error is bounded
+    by half the round trip - well under a millisecond on the local
+    network the stand runs on. Lowest-RTT exchanges give the tightest
+    bound, so an estimate is only replaced by a higher-RTT one once it
+    has gone stale.
+    """
+
+    WRAP = 1 << 32
+    STALE_S = 60.0
+
+    def __init__(self):
+        self._last_raw = None
+        self._wraps = 0
+        self._pending = {}      # t0 -> wall time the ack was sent
+        self._offset_at = 0.0
+        self.offset = None      # wall seconds minus device seconds
+        self.rtt_us = None      # round trip of the accepted exchange
+
+    def unwrap(self, raw_us):
+        """64-bit device microseconds from a 32-bit frame timestamp.
+
+        Tolerates mild reordering (a batch delivering samples slightly
+        older than an interleaved sync message): only a backwards jump
+        of more than half the counter range counts as a rollover.
+        """
+        if self._last_raw is not None and raw_us + self.WRAP // 2 < self._last_raw:
+            self._wraps += 1
+        if self._last_raw is None or raw_us > self._last_raw \
+                or raw_us + self.WRAP // 2 < self._last_raw:
+            self._last_raw = raw_us
+        return self._wraps * self.WRAP + raw_us
+
+    def note_sync_request(self, t0, server_time):
+        """Record the wall time at which t0's ack is being sent."""
+        self._pending[t0] = server_time
+        if len(self._pending) > 8:  # drop exchanges the device abandoned
+            self._pending.pop(next(iter(self._pending)))
+
+    def complete_sync(self, t0, t2):
+        """Fold a finished exchange into the offset estimate.
+
+        Returns the round trip in microseconds, or None if t0 was not
+        an outstanding sync request.
+        """
+        t1 = self._pending.pop(t0, None)
+        if t1 is None:
+            return None
+        rtt = (t2 - t0) & (self.WRAP - 1)
+        midpoint_us = self.unwrap(t0) + rtt / 2.0
+        offset = t1 - midpoint_us / 1e6
+        if (self.offset is None or rtt <= self.rtt_us
+                or t1 - self._offset_at > self.STALE_S):
+            self.offset = offset
+            self.rtt_us = rtt
+            self._offset_at = t1
+        return rtt
+
+    def wall_time(self, device_us):
+        """Map unwrapped device microseconds to wall seconds, or None
+        before the first completed sync exchange."""
+        if self.offset is None:
+            return None
+        return self.offset + device_us / 1e6
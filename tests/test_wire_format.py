@@ -0,0 +1,294 @@
+"""
+Unit tests for the binary wire format decoder.
+"""
+
+import pytest
+import struct
+import sys
+import os
+
+# Add server directory to path
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..', 'server'))
+
+import wire_format
+
+
+def encode_reading(seq, timestamp, raw, force):
+    """Build a reading frame the way the firmware encoder does."""
+    body = struct.pack('<2sBBIIif', wire_format.MAGIC, wire_format.VERSION,
+                       wire_format.FRAME_READING, seq, timestamp, raw, force)
+    return body + struct.pack('<H', wire_format.crc16(body))
+
+
+def encode_batch(first_seq, samples):
+    """Build a batch frame the way the firmware BatchEncoder does."""
+    body = struct.pack('<2sBBIH', wire_format.MAGIC, wire_format.VERSION,
+                       wire_format.FRAME_BATCH, first_seq, len(samples))
+    for timestamp, raw, force in samples:
+        body += struct.pack('<Iif', timestamp, raw, force)
+    return body + struct.pack('<H', wire_format.crc16(body))
+
+
+def encode_batch_mc(first_seq, channels, samples):
+    """Build a multi-channel batch frame. Each sample is
+    (timestamp, [raws], [forces])."""
+    body = struct.pack('<2sBBIHB', wire_format.MAGIC, wire_format.VERSION,
+                       wire_format.FRAME_BATCH_MC, first_seq, len(samples),
+                       channels)
+    for timestamp, raws, forces in samples:
+        body += struct.pack('<I', timestamp)
+        for ch in range(channels):
+            body += struct.pack('<if', raws[ch], forces[ch])
+    return body + struct.pack('<H', wire_format.crc16(body))
+
+
+def _zigzag(v):
+    return (v << 1) ^ (v >> 31) if v >= 0 else ((-v) << 1) - 1
+
+
+def _varint(v):
+    out = b''
+    while v >= 0x80:
+        out += bytes([(v & 0x7F) | 0x80])
+        v >>= 7
+    return out + bytes([v])
+
+
+def encode_batch_d(first_seq, calibration, samples):
+    """Build a delta batch frame the way the firmware DeltaBatchEncoder
+    does. calibration is [(scale, offset)] per channel; each sample is
+    (timestamp, [raws]). The first sample is stored absolute, the rest
+    as zigzag-varint deltas."""
+    channels = len(calibration)
+    payload = struct.pack('<I', samples[0][0])
+    for raw in samples[0][1]:
+        payload += struct.pack('<i', raw)
+    for i in range(1, len(samples)):
+        payload += _varint(_zigzag(samples[i][0] - samples[i - 1][0]))
+        for ch in range(channels):
+            payload += _varint(_zigzag(samples[i][1][ch] -
+                                       samples[i - 1][1][ch]))
+    body = struct.pack('<2sBBIHBH', wire_format.MAGIC, wire_format.VERSION,
+                       wire_format.FRAME_BATCH_D, first_seq, len(samples),
+                       channels, len(payload))
+    for scale, offset in calibration:
+        body += struct.pack('<fi', scale, offset)
+    body += payload
+    return body + struct.pack('<H', wire_format.crc16(body))
+
+
+class TestWireFormat:
+    """Test suite for binary frame decoding."""
+
+    def test_crc16_known_value(self):
+        """CRC-16/CCITT-FALSE of '123456789' is the standard check value."""
+        assert wire_format.crc16(b'123456789') == 0x29B1
+
+    def test_decode_reading_roundtrip(self):
+        """Encoded frame decodes back to the same fields."""
+        frame = encode_reading(seq=42, timestamp=123456, raw=-8388608, force=52.37)
+        reading = wire_format.decode_reading(frame)
+
+        assert reading['type'] == 'reading'
+        assert reading['seq'] == 42
+        assert reading['timestamp_us'] == 123456
+        assert reading['timestamp'] == 123.456  # presented in ms
+        assert reading['raw'] == -8388608
+        assert abs(reading['force'] - 52.37) < 0.01
+
+    def test_decode_rejects_bad_magic(self):
+        """Frames without the RT magic are rejected."""
+        frame = bytearray(encode_reading(0, 0, 0, 0.0))
+        frame[0] = ord('X')
+        with pytest.raises(wire_format.FrameError):
+            wire_format.decode_reading(bytes(frame))
+
+    def test_decode_rejects_corrupt_payload(self):
+        """A flipped payload byte fails the CRC check."""
+        frame = bytearray(encode_reading(1, 1000, 12345, 10.0))
+        frame[10] ^= 0xFF
+        with pytest.raises(wire_format.FrameError):
+            wire_format.decode_reading(bytes(frame))
+
+    def test_decode_rejects_short_frame(self):
+        """Truncated frames are rejected."""
+        frame = encode_reading(1, 1000, 12345, 10.0)
+        with pytest.raises(wire_format.FrameError):
+            wire_format.decode_reading(frame[:10])
+
+    def test_decode_frames_multiple(self):
+        """A payload of back-to-back frames decodes in order."""
+        payload = encode_reading(1, 100, 10, 1.0) + encode_reading(2, 112, 20, 2.0)
+        readings = wire_format.decode_frames(payload)
+
+        assert len(readings) == 2
+        assert readings[0]['seq'] == 1
+        assert readings[1]['seq'] == 2
+
+    def test_decode_batch(self):
+        """Batch frame expands into per-sample readings with
+        consecutive sequence numbers."""
+        samples = [(100, 10, 1.0), (112, 20, 2.0), (125, 30, 3.0)]
+        readings = wire_format.decode_batch(encode_batch(7, samples))
+
+        assert len(readings) == 3
+        assert [r['seq'] for r in readings] == [7, 8, 9]
+        assert [r['timestamp_us'] for r in readings] == [100, 112, 125]
+        assert [r['raw'] for r in readings] == [10, 20, 30]
+
+    def test_decode_batch_rejects_corruption(self):
+        """A flipped sample byte fails the batch CRC check."""
+        frame = bytearray(encode_batch(0, [(100, 10, 1.0), (112, 20, 2.0)]))
+        frame[15] ^= 0xFF
+        with pytest.raises(wire_format.FrameError):
+            wire_format.decode_batch(bytes(frame))
+
+    def test_decode_batch_mc(self):
+        """Multi-channel batch: channel 0 fills the scalar fields and
+        all channels land in the list fields."""
+        samples = [(100, [10, 11], [1.0, 1.1]), (112, [20, 21], [2.0, 2.1])]
+        readings = wire_format.decode_batch_mc(encode_batch_mc(4, 2, samples))
+
+        assert len(readings) == 2
+        assert [r['seq'] for r in readings] == [4, 5]
+        assert readings[0]['raw'] == 10
+        assert readings[0]['raws'] == [10, 11]
+        assert abs(readings[1]['forces'][1] - 2.1) < 0.01
+
+    def test_decode_frames_includes_mc_batches(self):
+        """Multi-channel batches mix with other frames in one payload."""
+        payload = encode_reading(1, 100, 10, 1.0) + \
+            encode_batch_mc(2, 3, [(112, [20, 21, 22], [2.0, 2.1, 2.2])])
+        readings = wire_format.decode_frames(payload)
+
+        assert [r['seq'] for r in readings] == [1, 2]
+        assert readings[1]['raws'] == [20, 21, 22]
+
+    def test_decode_batch_d(self):
+        """Delta batch: raw values survive zigzag round-tripping and
+        force is recomputed from the in-band calibration."""
+        samples = [(1000, [50000]), (13500, [50012]), (26000, [49990])]
+        readings = wire_format.decode_batch_d(
+            encode_batch_d(7, [(420.5, -1234)], samples))
+
+        assert [r['seq'] for r in readings] == [7, 8, 9]
+        assert [r['timestamp_us'] for r in readings] == [1000, 13500, 26000]
+        assert [r['raw'] for r in readings] == [50000, 50012, 49990]
+        # mass = (raw - offset) / scale, force = mass/1000 * g
+        expected = (50000 - -1234) / 420.5 / 1000.0 * 9.81
+        assert abs(readings[0]['force'] - expected) < 0.01
+
+    def test_decode_batch_d_multichannel(self):
+        """Each channel gets its own calibration and delta stream."""
+        samples = [(100, [50000, -20000]), (12600, [50100, -19000])]
+        readings = wire_format.decode_batch_d(
+            encode_batch_d(0, [(420.5, -1234), (380.0, 777)], samples))
+
+        assert readings[1]['raws'] == [50100, -19000]
+        expected = (-19000 - 777) / 380.0 / 1000.0 * 9.81
+        assert abs(readings[1]['forces'][1] - expected) < 0.01
+
+    def test_decode_frames_includes_delta_batches(self):
+        """The payload_len field lets the stream splitter skip a delta
+        batch without parsing its varints."""
+        payload = encode_batch_d(1, [(420.5, 0)], [(100, [10]), (112, [-20])]) + \
+            encode_reading(3, 125, 30, 3.0)
+        readings = wire_format.decode_frames(payload)
+
+        assert [r['seq'] for r in readings] == [1, 2, 3]
+        assert readings[1]['raw'] == -20
+
+    def test_decode_frames_mixed_types(self):
+        """Readings and batches can share one payload."""
+        payload = encode_reading(1, 100, 10, 1.0) + \
+            encode_batch(2, [(112, 20, 2.0), (125, 30, 3.0)])
+        readings = wire_format.decode_frames(payload)
+
+        assert [r['seq'] for r in readings] == [1, 2, 3]
+
+
+class TestEncodeCommand:
+    def test_stop_test_frame_layout(self):
+        """The abort command is a fixed 7-byte frame with a valid CRC."""
+        frame = wire_format.encode_command({'type': 'stop_test'})
+
+        assert frame[:2] == wire_format.MAGIC
+        assert frame[2] == wire_format.VERSION
+        assert frame[3] == wire_format.FRAME_COMMAND
+        assert frame[4] == wire_format.CMD_STOP_TEST
+        assert len(frame) == 7
+        crc, = struct.unpack('<H', frame[-2:])
+        assert crc == wire_format.crc16(frame[:-2])
+
+    def test_calibrate_payload(self):
+        """Calibrate carries the known mass and channel, little-endian."""
+        frame = wire_format.encode_command(
+            {'type': 'calibrate', 'known_mass': 500.0, 'channel': 1})
+
+        mass, channel = struct.unpack('<fB', frame[5:10])
+        assert mass == 500.0
+        assert channel == 1
+
+    def test_resend_payload(self):
+        frame = wire_format.encode_command(
+            {'type': 'resend', 'from': 1234, 'count': 40})
+
+        start, count = struct.unpack('<IH', frame[5:11])
+        assert (start, count) == (1234, 40)
+
+    def test_unmapped_type_falls_back_to_json(self):
+        """Configuration-shaped commands have no opcode."""
+        assert wire_format.encode_command({'type': 'set_filter'}) is None
+
+
+class TestDeviceClock:
+    """Test suite for device timestamp unwrapping and clock sync."""
+
+    def test_unwrap_monotonic(self):
+        """Plain increasing timestamps pass through unchanged."""
+        clock = wire_format.DeviceClock()
+        assert clock.unwrap(1000) == 1000
+        assert clock.unwrap(2000) == 2000
+
+    def test_unwrap_across_rollover(self):
+        """The 32-bit counter rolling over adds a wrap period."""
+        clock = wire_format.DeviceClock()
+        clock.unwrap(2**32 - 500)
+        assert clock.unwrap(500) == 2**32 + 500
+
+    def test_unwrap_tolerates_reordering(self):
+        """A slightly older timestamp (batch vs sync interleaving) is
+        not mistaken for a rollover."""
+        clock = wire_format.DeviceClock()
+        clock.unwrap(100000)
+        assert clock.unwrap(90000) == 90000
+        assert clock.unwrap(110000) == 110000
+
+    def test_sync_offset_estimate(self):
+        """A completed exchange yields offset = t1 - midpoint."""
+        clock = wire_format.DeviceClock()
+        clock.note_sync_request(1_000_000, server_time=500.0)
+        rtt = clock.complete_sync(1_000_000, 1_002_000)
+        assert rtt == 2000
+        # midpoint is 1.001 s of device time
+        assert abs(clock.offset - (500.0 - 1.001)) < 1e-9
+        assert abs(clock.wall_time(3_000_000) - (clock.offset + 3.0)) < 1e-9
+
+    def test_sync_keeps_lowest_rtt(self):
+        """A later, higher-RTT exchange does not displace a fresh
+        low-RTT estimate."""
+        clock = wire_format.DeviceClock()
+        clock.note_sync_request(1_000_000, server_time=500.0)
+        clock.complete_sync(1_000_000, 1_002_000)
+        first_offset = clock.offset
+        clock.note_sync_request(6_000_000, server_time=505.1)
+        clock.complete_sync(6_000_000, 6_100_000)  # 100 ms spike
+        assert clock.offset == first_offset
+        assert clock.rtt_us == 2000
+
+    def test_sync_unknown_t0_ignored(self):
+        """A result for an exchange we never acked is ignored."""
+        clock = wire_format.DeviceClock()
+        assert clock.complete_sync(123, 456) is None
+        assert clock.offset is None
+        assert clock.wall_time(1000) is None